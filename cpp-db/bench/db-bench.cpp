@@ -0,0 +1,313 @@
+#include "db-sqlite.hpp"
+#include "db.hpp"
+#ifdef DB_BENCH_PQ
+#include "db-pq.hpp"
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct bench_row {
+  int64_t id = 0;
+  std::string name;
+  int age = 0;
+  std::optional<double> score;
+};
+
+DB_ORM_SPECIALIZE(bench_row, id, name, age, score)
+
+namespace db::orm {
+template <>
+struct id<int64_t> {
+  static constexpr bool specialized = true;
+
+  static bool isNull(int64_t value) {
+    return value == 0;
+  }
+
+  // reset by the setup of each run, so that every run inserts the same ids
+  static inline int64_t next = 0;
+
+  static int64_t generate() {
+    return ++next;
+  }
+};
+} // namespace db::orm
+
+namespace bench {
+using clock = std::chrono::steady_clock;
+
+struct benchmark {
+  std::string name;
+  // operations done by one run of body, the rates are reported per operation
+  size_t ops;
+  std::function<void()> setup;
+  std::function<void()> body;
+};
+
+constexpr int runs = 5;
+
+std::string_view filter;
+
+bool selected(const std::string_view name) {
+  return name.find(filter) != std::string_view::npos;
+}
+
+// runs body once to warm up and then runs times, setup runs untimed before each of them
+void run(const benchmark& b) {
+  if (!selected(b.name)) {
+    return;
+  }
+
+  std::vector<clock::duration> durations;
+
+  for (int i = 0; i <= runs; i++) {
+    if (b.setup) {
+      b.setup();
+    }
+
+    auto since = clock::now();
+    b.body();
+    auto duration = clock::now() - since;
+
+    if (i > 0) {
+      durations.push_back(duration);
+    }
+  }
+
+  std::sort(durations.begin(), durations.end());
+
+  auto ns = [&](clock::duration d) {
+    return std::chrono::duration<double, std::nano>(d).count() / b.ops;
+  };
+
+  double median = ns(durations[durations.size() / 2]);
+
+  std::cout << std::left << std::setw(40) << b.name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(12) << median << " ns/op" << std::setw(12) << ns(durations.front()) << " min"
+            << std::setw(14) << std::setprecision(0) << 1e9 / median << " ops/s" << std::endl;
+}
+
+bench_row makeRow(int i) {
+  bench_row row;
+  row.name = "name " + std::to_string(i);
+  row.age = i % 100;
+  if (i % 2) {
+    row.score = i * 0.5;
+  }
+
+  return row;
+}
+
+// saveAll runs in a transaction of its own
+void insertRows(db::connection& conn, int rows) {
+  db::orm::repository repo(conn);
+
+  std::vector<bench_row> all;
+  for (int i = 0; i < rows; i++) {
+    all.push_back(makeRow(i));
+  }
+
+  repo.saveAll(all);
+}
+
+// in memory, so that the numbers show the library and not the disk
+void sqliteBenchmarks() {
+  constexpr int rows = 10000;
+
+  db::sqlite::datasource dsrc(":memory:");
+  db::connection conn(dsrc);
+
+  conn.execute("CREATE TABLE bench_row (id INTEGER PRIMARY KEY, name TEXT, age INTEGER, score REAL)");
+
+  auto clear = [&conn]() {
+    conn.execute("DELETE FROM bench_row");
+    db::orm::id<int64_t>::next = 0;
+  };
+
+  run({"sqlite/insert/statement", rows, clear, [&conn]() {
+         db::transaction tx(conn);
+         db::statement stmt(conn);
+         stmt.prepare("INSERT INTO bench_row (id, name, age, score) VALUES (:id, :name, :age, :score)");
+
+         for (int i = 0; i < rows; i++) {
+           auto row = makeRow(i);
+           stmt.params[":id"] = (int64_t)i + 1;
+           stmt.params[":name"] = row.name;
+           stmt.params[":age"] = row.age;
+           stmt.params[":score"] = row.score;
+           stmt.executeUpdate();
+         }
+       }});
+
+  run({"sqlite/insert/repository::save", rows, clear, [&conn]() {
+         db::transaction tx(conn);
+         db::orm::repository repo(conn);
+
+         for (int i = 0; i < rows; i++) {
+           auto row = makeRow(i);
+           repo.save(row);
+         }
+       }});
+
+  run({"sqlite/insert/repository::saveAll", rows, clear, [&conn]() {
+         insertRows(conn, rows);
+       }});
+
+  clear();
+  insertRows(conn, rows);
+
+  run({"sqlite/select/resultset", rows, nullptr, [&conn]() {
+         std::vector<bench_row> all;
+         db::statement stmt(conn);
+         stmt.prepare("SELECT id, name, age, score FROM bench_row");
+         db::resultset rslt(stmt);
+
+         while (rslt.next()) {
+           bench_row row;
+           rslt.get(0, row.id);
+           rslt.get(1, row.name);
+           rslt.get(2, row.age);
+           rslt.get(3, row.score);
+           all.push_back(std::move(row));
+         }
+       }});
+
+  run({"sqlite/select/findAll", rows, nullptr, [&conn]() {
+         auto all = db::orm::selector<bench_row>{conn}.select().findAll();
+       }});
+}
+
+void poolBenchmarks() {
+  constexpr int checkouts = 100000;
+  constexpr int threads = 16;
+
+  db::sqlite::datasource dsrc(":memory:");
+  db::pooled::options opts;
+  opts.min_size = 4;
+  opts.max_size = 4;
+
+  db::pooled::datasource single(dsrc, opts);
+
+  run({"pool/checkout/1 thread", checkouts, nullptr, [&single]() {
+         for (int i = 0; i < checkouts; i++) {
+           single.getConnection();
+         }
+       }});
+
+  // more threads than connections, so that most checkouts wait for another thread to give one back
+  db::pooled::datasource contended(dsrc, opts);
+  std::string name = "pool/checkout/16 threads 4 connections";
+
+  run({name, checkouts, nullptr, [&contended]() {
+         std::vector<std::thread> workers;
+
+         for (int t = 0; t < threads; t++) {
+           workers.emplace_back([&contended]() {
+             for (int i = 0; i < checkouts / threads; i++) {
+               contended.getConnection();
+             }
+           });
+         }
+
+         for (auto& worker : workers) {
+           worker.join();
+         }
+       }});
+
+  if (selected(name)) {
+    auto m = contended.getMetrics();
+    auto us = [](clock::duration d) {
+      return std::chrono::duration<double, std::micro>(d).count();
+    };
+
+    std::cout << "  waited " << std::setprecision(2) << us(m.averageWait()) << " us on average, at most "
+              << us(m.max_wait) << " us" << std::endl;
+  }
+}
+
+#ifdef DB_BENCH_PQ
+// runs against the server of DB_BENCH_PQ_CONNINFO, e.g. "host=localhost dbname=bench", in a temporary table
+void pqBenchmarks(const char* conninfo) {
+  constexpr int rows = 10000;
+
+  db::pq::datasource dsrc(conninfo);
+  db::connection conn(dsrc);
+
+  conn.execute("CREATE TEMPORARY TABLE bench_pq (id BIGINT, name TEXT)");
+
+  auto clear = [&conn]() {
+    conn.execute("TRUNCATE bench_pq");
+  };
+
+  run({"pq/insert/unprepared", rows, clear, [&conn]() {
+         db::transaction tx(conn);
+
+         for (int i = 0; i < rows; i++) {
+           conn.execute("INSERT INTO bench_pq VALUES (" + std::to_string(i) + ", 'name " + std::to_string(i) + "')");
+         }
+       }});
+
+  run({"pq/insert/prepared", rows, clear, [&conn]() {
+         db::transaction tx(conn);
+         db::statement stmt(conn);
+         stmt.prepare("INSERT INTO bench_pq VALUES (:id, :name)");
+
+         for (int i = 0; i < rows; i++) {
+           stmt.params[":id"] = (int64_t)i;
+           stmt.params[":name"] = "name " + std::to_string(i);
+           stmt.executeUpdate();
+         }
+       }});
+
+  run({"pq/insert/pipelined", rows, clear, [&conn]() {
+         db::transaction tx(conn);
+         db::statement stmt(conn);
+         stmt.prepare("INSERT INTO bench_pq VALUES (:id, :name)");
+
+         db::pq::datasource::pipeline pipeline(conn);
+
+         for (int i = 0; i < rows; i++) {
+           stmt.params[":id"] = (int64_t)i;
+           stmt.params[":name"] = "name " + std::to_string(i);
+           pipeline.add(stmt);
+         }
+
+         pipeline.sync();
+       }});
+}
+#endif
+} // namespace bench
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    bench::filter = argv[1];
+  }
+
+  try {
+    bench::sqliteBenchmarks();
+    bench::poolBenchmarks();
+
+#ifdef DB_BENCH_PQ
+    if (auto conninfo = std::getenv("DB_BENCH_PQ_CONNINFO")) {
+      bench::pqBenchmarks(conninfo);
+    } else {
+      std::cout << "pq benchmarks skipped, DB_BENCH_PQ_CONNINFO is not set" << std::endl;
+    }
+#endif
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "./db/group-commit.hpp"
+#include "./task.hpp"
+#include "./uvpp/timer.hpp"
+#include "./uvpp/work.hpp"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+namespace db::group_commit {
+// commits batches when they are full or when a timer of the loop fires max_delay after their first operation.
+// with CMAKE_ENABLE_THREADING batches run on the libuv threadpool, one at a time, otherwise inline on the loop.
+// callers always resume on the loop
+class async_batcher : public batcher {
+public:
+  async_batcher(db::datasource& dsrc, const options& opts = {}, uv_loop_t* native_loop = uv_default_loop())
+      : batcher(dsrc, opts), _native_loop(native_loop), _timer(native_loop) {
+  }
+
+  task<void> submitAsync(operation op) {
+    return task<void>::create([this, op](auto& resolve, auto& reject) {
+      bool full = submit(op, [&resolve, &reject](std::exception_ptr error) {
+        if (error) {
+          reject(error);
+        } else {
+          resolve();
+        }
+      });
+
+      schedule(full);
+    });
+  }
+
+private:
+  uv_loop_t* _native_loop;
+  uv::timer _timer;
+  bool _timer_active = false;
+  bool _flushing = false;
+
+  void schedule(bool full) {
+    if (_flushing) {
+      return;
+    }
+
+    if (full) {
+      flushInBackground();
+    } else if (!_timer_active && pending() > 0) {
+      _timer_active = true;
+
+      auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(getOptions().max_delay).count();
+      _timer.startOnce(std::max<int64_t>(delay, 0), [this]() {
+        _timer_active = false;
+        flushInBackground();
+      });
+    }
+  }
+
+  void flushInBackground() {
+    if (_flushing) {
+      return;
+    }
+
+    if (_timer_active) {
+      _timer.stop();
+      _timer_active = false;
+    }
+
+    auto b = std::make_shared<batch>(take());
+    if (b->empty()) {
+      return;
+    }
+
+    _flushing = true;
+
+#ifdef CMAKE_ENABLE_THREADING
+    auto results = std::make_shared<std::vector<std::exception_ptr>>();
+
+    uv::work::queue<bool>(
+        [this, b, results]() {
+          *results = execute(*b);
+          return true;
+        },
+        [this, b, results](auto&&, auto) {
+          completed(*b, *results);
+        },
+        _native_loop);
+#else
+    auto results = execute(*b);
+    completed(*b, results);
+#endif
+  }
+
+  // operations submitted while the batch ran form the next one
+  void completed(batch& b, std::vector<std::exception_ptr>& results) {
+    _flushing = false;
+
+    complete(b, results);
+    schedule(flushDue());
+  }
+};
+} // namespace db::group_commit
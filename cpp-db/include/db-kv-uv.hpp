@@ -0,0 +1,126 @@
+#pragma once
+
+#include "./db/kv-store.hpp"
+#include "./task.hpp"
+#include "./uvpp/timer.hpp"
+#include "./uvpp/work.hpp"
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace db::kv {
+// a store whose writes are flushed by a timer of the loop. with CMAKE_ENABLE_THREADING queries and flushes
+// run on the libuv threadpool and only cache hits are answered on the loop, otherwise they run inline.
+// the store has to outlive the tasks it returns and its background flushes
+class async_store : public store {
+public:
+  async_store(db::datasource& dsrc, const options& opts = {}, uv_loop_t* native_loop = uv_default_loop())
+      : store(dsrc, withoutFlushOnWrite(opts)), _native_loop(native_loop), _timer(native_loop) {
+    auto interval = std::chrono::duration_cast<std::chrono::milliseconds>(opts.flush_interval).count();
+    interval = std::max<int64_t>(interval, 1);
+
+    _timer.start(
+        [this]() {
+          if (pending() > 0) {
+            flushInBackground();
+          }
+        },
+        interval, interval);
+
+    // buffered writes alone should not keep the loop running
+    uv_unref(_timer);
+  }
+
+  task<std::optional<std::string>> getAsync(const std::string key) {
+    if (auto hit = cached(key)) {
+      co_return *hit;
+    }
+
+    co_return co_await run<std::optional<std::string>>([this, key]() {
+      return get(key);
+    });
+  }
+
+  task<std::vector<std::optional<std::string>>> multiGetAsync(const std::vector<std::string> keys) {
+    co_return co_await run<std::vector<std::optional<std::string>>>([this, &keys]() {
+      return multiGet(keys);
+    });
+  }
+
+  // the write is visible to reads right away, a due buffer is flushed in the background
+  task<void> setAsync(const std::string key, std::string value) {
+    set(key, std::move(value));
+
+    if (flushDue()) {
+      flushInBackground();
+    }
+
+    co_return;
+  }
+
+  task<void> eraseAsync(const std::string key) {
+    erase(key);
+
+    if (flushDue()) {
+      flushInBackground();
+    }
+
+    co_return;
+  }
+
+  task<void> flushAsync() {
+    co_await run<bool>([this]() {
+      flush();
+      return true;
+    });
+  }
+
+private:
+  uv_loop_t* _native_loop;
+  uv::timer _timer;
+  bool _flushing = false;
+
+  static options withoutFlushOnWrite(options opts) {
+    opts.flush_on_write = false;
+    return opts;
+  }
+
+  template <typename T>
+  task<T> run(std::function<T()> fn) {
+#ifdef CMAKE_ENABLE_THREADING
+    co_return co_await uv::work::queue<T>(std::move(fn), _native_loop);
+#else
+    co_return fn();
+#endif
+  }
+
+  // failed batches stay buffered and are retried by the next tick
+  void flushInBackground() {
+    if (_flushing) {
+      return;
+    }
+
+    _flushing = true;
+
+#ifdef CMAKE_ENABLE_THREADING
+    uv::work::queue<bool>(
+        [this]() {
+          flush();
+          return true;
+        },
+        [this](auto&&, auto) {
+          _flushing = false;
+        },
+        _native_loop);
+#else
+    try {
+      flush();
+    } catch (...) {
+    }
+
+    _flushing = false;
+#endif
+  }
+};
+} // namespace db::kv
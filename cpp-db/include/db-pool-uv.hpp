@@ -0,0 +1,45 @@
+#pragma once
+
+#include "./db/pool.hpp"
+#include "./task.hpp"
+#include "./uvpp/async.hpp"
+#include <exception>
+#include <memory>
+
+namespace db::pooled {
+// waits for a free connection of the pool without blocking the loop and resumes on it. the connection may be given
+// back on any thread, e.g. a threadpool worker, which wakes the loop up through an async handle
+inline task<std::shared_ptr<db::datasource::connection>> getConnectionAsync(
+    datasource& pool, uv_loop_t* native_loop = uv_default_loop()) {
+  return task<std::shared_ptr<db::datasource::connection>>::create([&pool, native_loop](auto& resolve, auto& reject) {
+    struct state {
+      uv::async wakeup;
+      std::shared_ptr<db::datasource::connection> connection;
+      std::exception_ptr error;
+
+      state(uv_loop_t* native_loop) : wakeup(native_loop) {
+      }
+    };
+
+    auto s = new state(native_loop);
+
+    s->wakeup.start([s, &resolve, &reject]() {
+      auto connection = std::move(s->connection);
+      auto error = s->error;
+      delete s;
+
+      if (error) {
+        reject(error);
+      } else {
+        resolve(connection);
+      }
+    });
+
+    pool.getConnection([s](auto connection, auto error) {
+      s->connection = std::move(connection);
+      s->error = error;
+      uv_async_send(s->wakeup);
+    });
+  });
+}
+} // namespace db::pooled
@@ -0,0 +1,483 @@
+#pragma once
+
+#include "./db-pq.hpp"
+#include "./db-pool-uv.hpp"
+#include "./db/resultset.hpp"
+#include "./db/statement.hpp"
+#include "./task.hpp"
+#include "./uvpp/poll.hpp"
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace db::pq {
+class async_connection : public datasource::connection {
+public:
+  // native_connection may still be connecting when it was started with PQconnectStart
+  async_connection(std::shared_ptr<PGconn> native_connection, uv_loop_t* native_loop = uv_default_loop())
+      : datasource::connection(native_connection), _native_loop(native_loop) {
+    if (PQstatus(&*_native_connection) == CONNECTION_OK) {
+      connected();
+    }
+  }
+
+  // only starts connecting, the first async operation finishes the connection on the loop
+  async_connection(const std::string_view conninfo, uv_loop_t* native_loop = uv_default_loop())
+      : async_connection(startConnect(conninfo), native_loop) {
+  }
+
+  virtual ~async_connection() override {
+  }
+
+  static task<std::shared_ptr<async_connection>> connect(
+      const std::string conninfo, uv_loop_t* native_loop = uv_default_loop()) {
+    auto conn = std::make_shared<async_connection>(conninfo, native_loop);
+
+    co_await conn->acquire();
+    conn->release();
+
+    co_return conn;
+  }
+
+  // synchronous calls block the loop and need an established connection
+  void execute(const std::string_view script) override {
+    if (!_poll) {
+      throw pq_error("async_connection is still connecting, await an async operation first");
+    }
+
+    datasource::connection::execute(script);
+  }
+
+  task<void> executeAsync(const std::string_view script) {
+    co_await acquire();
+    guard g{*this};
+
+    co_await sendQuery(script);
+  }
+
+  task<std::shared_ptr<PGresult>> executeAsync(datasource::statement& statement) {
+    co_await acquire();
+    guard g{*this};
+
+    if (statement.pgAcquire()) {
+      // the cache entry only stays once the statement exists on the server
+      std::string deallocate;
+      std::exception_ptr error;
+
+      try {
+        deallocate = _statement_cache->takeDeallocateScript();
+        if (!deallocate.empty()) {
+          co_await sendQuery(deallocate);
+          deallocate.clear();
+        }
+
+        if (!statement.pgSendPrepare()) {
+          throw pq_error(_native_connection);
+        }
+
+        co_await flush();
+        co_await lastResult();
+
+        if (!statement.pgSendDescribePrepared()) {
+          throw pq_error(_native_connection);
+        }
+
+        co_await flush();
+        auto description = co_await lastResult();
+        statement.pgLearnResultFormat(&*description);
+      } catch (...) {
+        error = std::current_exception();
+      }
+
+      if (error) {
+        statement.pgForget();
+
+        if (!deallocate.empty()) {
+          try {
+            std::rethrow_exception(error);
+          } catch (const pq_error& e) {
+            _statement_cache->deallocateFailed(std::move(deallocate), e);
+          } catch (...) {
+          }
+        }
+
+        std::rethrow_exception(error);
+      }
+    }
+
+    if (!statement.pgSendQueryPrepared()) {
+      throw pq_error(_native_connection);
+    }
+
+    co_await flush();
+    co_return co_await lastResult();
+  }
+
+  task<std::shared_ptr<db::datasource::resultset>> queryAsync(datasource::statement& statement) {
+    co_return std::make_shared<datasource::resultset>(_native_connection, co_await executeAsync(statement));
+  }
+
+  task<int> executeUpdateAsync(datasource::statement& statement) {
+    auto result = co_await executeAsync(statement);
+
+    co_return std::atoi(PQcmdTuples(&*result));
+  }
+
+  template <typename T, typename R>
+  task<int64_t> copyInAsync(copy_encoder<T>& encoder, const R& rows, size_t buffer_size = 65536) {
+    co_await acquire();
+    guard g{*this};
+
+    co_await startCopy(encoder.script(), PGRES_COPY_IN);
+
+    std::exception_ptr error;
+    try {
+      for (const auto& row : rows) {
+        encoder.encode(row);
+
+        if (encoder.buffer().length() >= buffer_size) {
+          co_await putCopyData(encoder.buffer());
+          encoder.buffer().clear();
+        }
+      }
+
+      encoder.finish();
+      co_await putCopyData(encoder.buffer());
+      encoder.buffer().clear();
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    int status;
+    while ((status = PQputCopyEnd(&*_native_connection, error ? "copy aborted" : nullptr)) == 0) {
+      co_await wait(*_poll, UV_WRITABLE);
+    }
+
+    if (status < 0) {
+      throw pq_error(_native_connection);
+    }
+
+    co_await flush();
+
+    if (error) {
+      try {
+        co_await lastResult();
+      } catch (const pq_error&) {
+      }
+
+      std::rethrow_exception(error);
+    }
+
+    auto result = co_await lastResult();
+
+    co_return std::atoll(PQcmdTuples(&*result));
+  }
+
+  template <typename T>
+  task<int64_t> copyOutAsync(copy_decoder<T>& decoder, std::function<void(T&)> cb) {
+    co_await acquire();
+    guard g{*this};
+
+    co_await startCopy(decoder.script(), PGRES_COPY_OUT);
+
+    std::exception_ptr error;
+    while (true) {
+      char* buf;
+      int length = PQgetCopyData(&*_native_connection, &buf, 1);
+
+      if (length == 0) {
+        co_await wait(*_poll, UV_READABLE);
+
+        if (!PQconsumeInput(&*_native_connection)) {
+          throw pq_error(_native_connection);
+        }
+
+        continue;
+      }
+
+      if (length == -2) {
+        throw pq_error(_native_connection);
+      }
+
+      if (length == -1) {
+        break;
+      }
+
+      std::unique_ptr<char, decltype(&PQfreemem)> chunk{buf, &PQfreemem};
+
+      // keep reading after an error so the connection ends up idle
+      if (!error) {
+        try {
+          decoder.decode({buf, (size_t)length}, cb);
+        } catch (...) {
+          error = std::current_exception();
+        }
+      }
+    }
+
+    auto result = co_await lastResult();
+
+    if (error) {
+      std::rethrow_exception(error);
+    }
+
+    co_return std::atoll(PQcmdTuples(&*result));
+  }
+
+private:
+  struct guard {
+    async_connection& conn;
+
+    ~guard() {
+      conn.release();
+    }
+  };
+
+  uv_loop_t* _native_loop;
+  std::unique_ptr<uv::poll> _poll;
+
+  bool _busy = false;
+  std::deque<std::function<void()>> _waiters;
+
+  // socket errors surface as UV_EBADF, let libpq report the actual cause on its next call
+  static task<int> wait(uv::poll& poll, int events) {
+    try {
+      co_return co_await poll.startOnce(events);
+    } catch (const uv::error&) {
+      co_return events;
+    }
+  }
+
+  task<void> sendQuery(const std::string_view script) {
+    if (!PQsendQuery(&*_native_connection, std::string{script}.data())) {
+      throw pq_error(_native_connection);
+    }
+
+    co_await flush();
+    co_await lastResult();
+  }
+
+  task<void> startCopy(const std::string& script, ExecStatusType expected) {
+    if (!PQsendQuery(&*_native_connection, script.data())) {
+      throw pq_error(_native_connection);
+    }
+
+    co_await flush();
+
+    auto result = co_await nextResult();
+    if (!result || PQresultStatus(&*result) != expected) {
+      while (co_await nextResult()) {
+      }
+
+      throw result ? pq_error(result) : pq_error(_native_connection);
+    }
+  }
+
+  task<void> putCopyData(const std::string& buffer) {
+    int status;
+    while ((status = PQputCopyData(&*_native_connection, buffer.data(), buffer.length())) == 0) {
+      co_await flush();
+    }
+
+    if (status < 0) {
+      throw pq_error(_native_connection);
+    }
+  }
+
+  static std::shared_ptr<PGconn> startConnect(const std::string_view conninfo) {
+    std::shared_ptr<PGconn> native_connection{PQconnectStart(std::string{conninfo}.data()), &PQfinish};
+    if (!native_connection) {
+      throw pq_error("could not allocate connection");
+    }
+
+    return native_connection;
+  }
+
+  void connected() {
+    _poll = std::make_unique<uv::poll>(PQsocket(&*_native_connection), _native_loop);
+
+    if (PQsetnonblocking(&*_native_connection, 1) != 0) {
+      throw pq_error(_native_connection);
+    }
+  }
+
+  task<void> finishConnect() {
+    if (PQstatus(&*_native_connection) == CONNECTION_BAD) {
+      throw pq_error(_native_connection);
+    }
+
+    std::unique_ptr<uv::poll> poll;
+    int socket = -1;
+
+    auto status = PGRES_POLLING_WRITING;
+    while (status != PGRES_POLLING_OK) {
+      if (status == PGRES_POLLING_FAILED) {
+        throw pq_error(_native_connection);
+      }
+
+      // the socket only changes while libpq tries multiple hosts
+      if (!poll || PQsocket(&*_native_connection) != socket) {
+        socket = PQsocket(&*_native_connection);
+        poll = std::make_unique<uv::poll>(socket, _native_loop);
+      }
+
+      co_await wait(*poll, status == PGRES_POLLING_READING ? UV_READABLE : UV_WRITABLE);
+
+      status = PQconnectPoll(&*_native_connection);
+    }
+
+    poll.reset();
+    connected();
+  }
+
+  // libpq allows one query in flight per connection, so concurrent callers queue up in order.
+  // the first caller also finishes connecting
+  task<void> acquire() {
+    if (!_busy) {
+      _busy = true;
+    } else {
+      co_await task<void>::create([this](auto& resolve, auto& reject) {
+        _waiters.emplace_back(resolve);
+      });
+    }
+
+    if (!_poll) {
+      try {
+        co_await finishConnect();
+      } catch (...) {
+        release();
+        throw;
+      }
+    }
+  }
+
+  void release() {
+    if (_waiters.empty()) {
+      _busy = false;
+      return;
+    }
+
+    auto next = std::move(_waiters.front());
+    _waiters.pop_front();
+
+    next();
+  }
+
+  task<void> flush() {
+    while (true) {
+      int status = PQflush(&*_native_connection);
+      if (status == 0) {
+        co_return;
+      }
+
+      if (status < 0) {
+        throw pq_error(_native_connection);
+      }
+
+      int events = co_await wait(*_poll, UV_READABLE | UV_WRITABLE);
+
+      if ((events & UV_READABLE) && !PQconsumeInput(&*_native_connection)) {
+        throw pq_error(_native_connection);
+      }
+    }
+  }
+
+  task<std::shared_ptr<PGresult>> nextResult() {
+    while (true) {
+      if (!PQconsumeInput(&*_native_connection)) {
+        throw pq_error(_native_connection);
+      }
+
+      if (!PQisBusy(&*_native_connection)) {
+        PGresult* result = PQgetResult(&*_native_connection);
+
+        co_return result ? std::shared_ptr<PGresult>{result, &PQclear} : nullptr;
+      }
+
+      co_await wait(*_poll, UV_READABLE);
+    }
+  }
+
+  task<std::shared_ptr<PGresult>> lastResult() {
+    std::shared_ptr<PGresult> last;
+    std::shared_ptr<PGresult> error;
+
+    while (auto result = co_await nextResult()) {
+      auto status = PQresultStatus(&*result);
+      if (!error && status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+        error = result;
+      }
+
+      last = result;
+    }
+
+    if (error) {
+      throw pq_error(error);
+    }
+
+    if (!last) {
+      throw pq_error(_native_connection);
+    }
+
+    co_return last;
+  }
+};
+
+class async_datasource : public db::datasource {
+public:
+  async_datasource(const std::string_view conninfo, uv_loop_t* native_loop = uv_default_loop())
+      : _conninfo(conninfo), _native_loop(native_loop) {
+  }
+
+  // does not block, the connection is established by its first async operation
+  std::shared_ptr<db::datasource::connection> getConnection() override {
+    return std::make_shared<async_connection>(_conninfo, _native_loop);
+  }
+
+private:
+  std::string _conninfo;
+  uv_loop_t* _native_loop;
+};
+
+task<std::shared_ptr<db::datasource::resultset>> executeAsync(db::statement& statement) {
+  auto conn = statement.getConnection().getNativeConnection<async_connection>();
+  if (!conn) {
+    throw pq_error("statement does not belong to an async_connection");
+  }
+
+  co_return co_await conn->queryAsync(*statement.getNativeStatement<datasource::statement>());
+}
+
+template <typename T, typename R>
+task<int64_t> copyInAsync(
+    db::connection& conn, const R& rows, const std::string table = db::orm::meta<T>::class_name) {
+  auto native = conn.getNativeConnection<async_connection>();
+  if (!native) {
+    throw pq_error("connection is not an async_connection");
+  }
+
+  copy_encoder<T> encoder{conn, table};
+  co_return co_await native->copyInAsync(encoder, rows);
+}
+
+template <typename T>
+task<int64_t> copyOutAsync(db::connection& conn, std::function<void(T&)> cb, const std::string query = "") {
+  auto native = conn.getNativeConnection<async_connection>();
+  if (!native) {
+    throw pq_error("connection is not an async_connection");
+  }
+
+  copy_decoder<T> decoder{query};
+  co_return co_await native->copyOutAsync(decoder, cb);
+}
+
+task<int> executeUpdateAsync(db::statement& statement) {
+  auto conn = statement.getConnection().getNativeConnection<async_connection>();
+  if (!conn) {
+    throw pq_error("statement does not belong to an async_connection");
+  }
+
+  co_return co_await conn->executeUpdateAsync(*statement.getNativeStatement<datasource::statement>());
+}
+} // namespace db::pq
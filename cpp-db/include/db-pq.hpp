@@ -1,9 +1,20 @@
 #pragma once
 
 #include "./db/datasource.hpp"
+#include "./db/orm.hpp"
+#include "./db/resultset.hpp"
+#include "./db/statement.hpp"
+#include <bit>
+#include <charconv>
+#include <ctime>
+#include <iostream>
 #include <libpq-fe.h>
-#include <set>
+#include <list>
+#include <optional>
 #include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace db::pq {
 namespace types {
@@ -21,10 +32,15 @@ constexpr int _oid = 26;
 constexpr int _xid = 28;
 constexpr int _cid = 29;
 
+constexpr int _json = 114;
+
 constexpr int _float4 = 700; // 32-bit
 constexpr int _float8 = 701; // 64-bit
 constexpr int _unknown = 705;
 
+constexpr int _bpchar = 1042;
+constexpr int _varchar = 1043;
+
 constexpr int _date = 1082;
 constexpr int _time = 1083;
 
@@ -38,6 +54,277 @@ constexpr int _numeric = 1700;
 constexpr int _uuid = 2950;
 } // namespace types
 
+namespace detail {
+// postgres epoch (2000-01-01) in unix time
+constexpr int64_t epoch_offset = 946684800;
+
+template <typename T>
+T fromNetwork(const char* bytes) {
+  T result = 0;
+  for (size_t i = 0; i < sizeof(T); i++) {
+    result = (result << 8) | (uint8_t)bytes[i];
+  }
+  return result;
+}
+
+template <typename T>
+std::string toNetwork(T value) {
+  std::string result(sizeof(T), '\0');
+  for (size_t i = sizeof(T); i-- > 0;) {
+    result[i] = (char)(value & 0xff);
+    value >>= 8;
+  }
+  return result;
+}
+
+inline std::string formatNumeric(const char* bytes) {
+  int ndigits = (int16_t)fromNetwork<uint16_t>(bytes);
+  int weight = (int16_t)fromNetwork<uint16_t>(bytes + 2);
+  int sign = fromNetwork<uint16_t>(bytes + 4);
+  int dscale = (int16_t)fromNetwork<uint16_t>(bytes + 6);
+
+  switch (sign) {
+  case 0xC000:
+    return "NaN";
+  case 0xD000:
+    return "Infinity";
+  case 0xF000:
+    return "-Infinity";
+  }
+
+  auto digit = [&](int i) -> int {
+    return (i >= 0 && i < ndigits) ? fromNetwork<uint16_t>(bytes + 8 + i * 2) : 0;
+  };
+
+  std::string result = sign == 0x4000 ? "-" : "";
+
+  if (weight < 0) {
+    result += '0';
+  } else {
+    result += std::to_string(digit(0));
+
+    for (int i = 1; i <= weight; i++) {
+      auto group = std::to_string(digit(i));
+      result.append(4 - group.length(), '0') += group;
+    }
+  }
+
+  if (dscale > 0) {
+    std::string fraction;
+    for (int i = weight + 1; (int)fraction.length() < dscale; i++) {
+      auto group = std::to_string(digit(i));
+      fraction.append(4 - group.length(), '0') += group;
+    }
+
+    result += '.';
+    result += fraction.substr(0, dscale);
+  }
+
+  return result;
+}
+
+inline std::string formatTimestamp(int64_t micros, const char* format) {
+  int64_t seconds = micros / 1000000;
+  int64_t fraction = micros % 1000000;
+  if (fraction < 0) {
+    seconds -= 1;
+    fraction += 1000000;
+  }
+
+  std::time_t t = epoch_offset + seconds;
+  std::tm tm;
+  gmtime_r(&t, &tm);
+
+  char buf[64];
+  size_t length = strftime(buf, sizeof(buf), format, &tm);
+
+  std::string result{buf, length};
+  if (fraction != 0) {
+    auto digits = std::to_string(1000000 + fraction).substr(1);
+    result += '.';
+    result += digits.substr(0, digits.find_last_not_of('0') + 1);
+  }
+
+  return result;
+}
+
+// days since 1970-01-01 of a proleptic gregorian date
+constexpr int64_t daysFromCivil(int64_t y, int64_t m, int64_t d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  return era * 146097 + doe - 719468;
+}
+
+// parses the ISO text output of date, time, timestamp and timestamptz into what the binary format holds:
+// microseconds since the postgres epoch, or since midnight for a time. zone offsets are applied, so
+// timestamptz values end up in UTC
+inline int64_t parseTimestamp(std::string_view text) {
+  const char* p = text.data();
+  const char* end = p + text.length();
+
+  auto number = [&p, end]() {
+    int64_t value = 0;
+    p = std::from_chars(p, end, value).ptr;
+    return value;
+  };
+
+  auto skip = [&p, end](char c) {
+    if (p < end && *p == c) {
+      p++;
+      return true;
+    }
+
+    return false;
+  };
+
+  int64_t micros = 0;
+  int64_t value = number();
+
+  if (skip('-')) {
+    int64_t month = number();
+    skip('-');
+    int64_t day = number();
+
+    micros = (daysFromCivil(value, month, day) * 86400 - epoch_offset) * 1000000;
+
+    if (!skip(' ') && !skip('T')) {
+      return micros;
+    }
+
+    value = number();
+  }
+
+  if (!skip(':')) {
+    return micros;
+  }
+
+  int64_t minutes = number();
+  int64_t seconds = skip(':') ? number() : 0;
+  micros += ((value * 60 + minutes) * 60 + seconds) * 1000000;
+
+  if (skip('.')) {
+    int64_t scale = 100000;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, scale /= 10) {
+      micros += (*p - '0') * scale;
+    }
+  }
+
+  if (p < end && (*p == '+' || *p == '-')) {
+    int64_t sign = *p++ == '-' ? -1 : 1;
+    int64_t offset = number() * 3600;
+
+    if (skip(':')) {
+      offset += number() * 60;
+    }
+
+    if (skip(':')) {
+      offset += number();
+    }
+
+    micros -= sign * offset * 1000000;
+  }
+
+  return micros;
+}
+
+inline int hexValue(char c) {
+  return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+#ifdef __SIZEOF_INT128__
+inline __uint128_t parseUuid(std::string_view text) {
+  __uint128_t result = 0;
+
+  for (char c : text) {
+    if (c != '-' && c != '{' && c != '}') {
+      result = (result << 4) | hexValue(c);
+    }
+  }
+
+  return result;
+}
+#endif
+
+// decodes the hex text output of bytea, the escape format is returned as it is
+inline std::vector<uint8_t> parseBytea(const char* text, size_t length) {
+  if (length < 2 || text[0] != '\\' || text[1] != 'x') {
+    return {text, text + length};
+  }
+
+  std::vector<uint8_t> result;
+  result.reserve((length - 2) / 2);
+
+  for (size_t i = 2; i + 1 < length; i += 2) {
+    result.push_back((uint8_t)(hexValue(text[i]) << 4 | hexValue(text[i + 1])));
+  }
+
+  return result;
+}
+
+// the text output of a value in binary format, so that both formats decode into the same strings
+inline std::string formatBinary(Oid type, const char* value, size_t length) {
+  static constexpr char hex[] = "0123456789abcdef";
+
+  switch (type) {
+  case types::_bool:
+    return *value ? "t" : "f";
+  case types::_int2:
+    return std::to_string((int16_t)fromNetwork<uint16_t>(value));
+  case types::_int4:
+    return std::to_string((int32_t)fromNetwork<uint32_t>(value));
+  case types::_oid:
+    return std::to_string(fromNetwork<uint32_t>(value));
+  case types::_int8:
+    return std::to_string((int64_t)fromNetwork<uint64_t>(value));
+  case types::_float4: {
+    char buf[32];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), std::bit_cast<float>(fromNetwork<uint32_t>(value)));
+    return {buf, end};
+  }
+  case types::_float8: {
+    char buf[32];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), std::bit_cast<double>(fromNetwork<uint64_t>(value)));
+    return {buf, end};
+  }
+  case types::_numeric:
+    return formatNumeric(value);
+  case types::_date:
+    return formatTimestamp((int64_t)(int32_t)fromNetwork<uint32_t>(value) * 86400 * 1000000, "%Y-%m-%d");
+  case types::_time:
+    return formatTimestamp((int64_t)fromNetwork<uint64_t>(value), "%H:%M:%S");
+  case types::_timestamp:
+    return formatTimestamp((int64_t)fromNetwork<uint64_t>(value), "%Y-%m-%d %H:%M:%S");
+  case types::_timestamptz:
+    return formatTimestamp((int64_t)fromNetwork<uint64_t>(value), "%Y-%m-%d %H:%M:%S") + "+00";
+  case types::_uuid: {
+    std::string result;
+    for (int i = 0; i < 16; i++) {
+      if (i == 4 || i == 6 || i == 8 || i == 10) {
+        result += '-';
+      }
+      result += hex[(uint8_t)value[i] >> 4];
+      result += hex[(uint8_t)value[i] & 0xf];
+    }
+    return result;
+  }
+  case types::_bytea: {
+    std::string result = "\\x";
+    for (size_t i = 0; i < length; i++) {
+      result += hex[(uint8_t)value[i] >> 4];
+      result += hex[(uint8_t)value[i] & 0xf];
+    }
+    return result;
+  }
+  default:
+    return {value, length};
+  }
+}
+} // namespace detail
+
 class pq_error : public db::sql_error {
 public:
   pq_error(const std::string& msg) : db::sql_error(msg) {
@@ -47,6 +334,14 @@ public:
   }
 
   pq_error(std::shared_ptr<PGresult> res) : db::sql_error(PQresultErrorMessage(&*res)) {
+    if (auto sqlstate = PQresultErrorField(&*res, PG_DIAG_SQLSTATE)) {
+      _sqlstate = sqlstate;
+    }
+  }
+
+  // the SQLSTATE code reported by the server, empty for client side errors
+  const std::string& sqlState() const noexcept {
+    return _sqlstate;
   }
 
   static void assert(std::shared_ptr<PGconn> db) {
@@ -62,76 +357,171 @@ public:
       throw pq_error(res);
     }
   }
+
+private:
+  std::string _sqlstate;
 };
 
 class datasource : public db::datasource {
 public:
-  class resultset : public db::datasource::resultset {
+  class pipeline;
+  class statement;
+
+  class resultset final : public db::datasource::resultset {
   public:
+    friend statement;
+
     resultset(std::shared_ptr<PGconn> native_connection, std::shared_ptr<PGresult> native_resultset)
         : _native_connection(native_connection), _native_resultset(native_resultset) {
     }
 
+    // takes the rows of the query in flight on native_connection as they arrive in single-row or chunked mode
+    explicit resultset(std::shared_ptr<PGconn> native_connection)
+        : _native_connection(native_connection), _streaming(true) {
+      fetch();
+    }
+
     virtual ~resultset() override {
+      if (!_streaming || _done) {
+        return;
+      }
+
+      // rows that already arrived are skipped, only a query that is still sending gets cancelled. a cancel opens
+      // a connection of its own, so it is not worth it for the tail of a small result
+      while (PQconsumeInput(&*_native_connection) && !PQisBusy(&*_native_connection)) {
+        auto result = PQgetResult(&*_native_connection);
+        if (!result) {
+          return;
+        }
+
+        PQclear(result);
+      }
+
+      if (auto cancel = PQgetCancel(&*_native_connection)) {
+        char errbuf[256];
+        PQcancel(cancel, errbuf, sizeof(errbuf));
+        PQfreeCancel(cancel);
+      }
+
+      while (auto result = PQgetResult(&*_native_connection)) {
+        PQclear(result);
+      }
     }
 
     bool next() override {
       _row += 1;
 
+      if (_streaming && !_done && _row >= PQntuples(&*_native_resultset)) {
+        fetch();
+        _row = 0;
+      }
+
       return PQntuples(&*_native_resultset) > _row;
     }
 
-    bool isValueNull(const std::string_view name) override {
-      return PQgetisnull(&*_native_resultset, _row, columnIndex(name));
+    using db::datasource::resultset::getValue;
+    using db::datasource::resultset::isValueNull;
+
+    void getValues(const binding* bindings, size_t len, void* const* targets, bool* nulls) override {
+      db::datasource::resultset::getValues(*this, bindings, len, targets, nulls);
     }
 
-    void getValue(const std::string_view name, bool& result) override {
-      result = *PQgetvalue(&*_native_resultset, _row, columnIndex(name)) != 'f';
+    bool isValueNull(int col) override {
+      return col < 0 || PQgetisnull(&*_native_resultset, _row, col);
     }
 
-    void getValue(int col, int& result) {
-      result = std::atoi(PQgetvalue(&*_native_resultset, _row, col));
+    void getValue(int col, bool& result) override {
+      auto value = PQgetvalue(&*_native_resultset, _row, col);
+
+      result = isBinary(col) ? *value != 0 : *value != 'f';
     }
 
-    void getValue(const std::string_view name, int& result) override {
-      getValue(columnIndex(name), result);
+    void getValue(int col, int& result) override {
+      result = (int)getInteger(col);
     }
 
-    void getValue(const std::string_view name, int64_t& result) override {
-      result = std::atoll(PQgetvalue(&*_native_resultset, _row, columnIndex(name)));
+    void getValue(int col, int64_t& result) override {
+      result = getInteger(col);
     }
 
 #ifdef __SIZEOF_INT128__
-    void getValue(const std::string_view name, __uint128_t& result) override {
+    void getValue(int col, __uint128_t& result) override {
+      if (PQftype(&*_native_resultset, col) == types::_uuid) {
+        auto value = PQgetvalue(&*_native_resultset, _row, col);
+        result = isBinary(col) ? detail::fromNetwork<__uint128_t>(value) : detail::parseUuid(value);
+        return;
+      }
+
       const void* bytes;
-      getValue(name, &bytes);
+      getValue(col, &bytes);
       result = *(__uint128_t*)bytes;
     }
 #endif
 
-    void getValue(const std::string_view name, double& result) override {
-      result = std::atof(PQgetvalue(&*_native_resultset, _row, columnIndex(name)));
+    void getValue(int col, double& result) override {
+      result = getFloat(col);
     }
 
-    void getValue(const std::string_view name, std::string& result) override {
-      auto col = columnIndex(name);
+    void getValue(int col, std::string& result) override {
+      if (isBinary(col)) {
+        result = getText(col);
+        return;
+      }
+
       auto text_ptr = PQgetvalue(&*_native_resultset, _row, col);
       auto byte_count = PQgetlength(&*_native_resultset, _row, col);
 
+      // the server prints timestamptz in the session's zone, binary values are always UTC
+      if (PQftype(&*_native_resultset, col) == types::_timestamptz) {
+        result = detail::formatTimestamp(getInteger(col), "%Y-%m-%d %H:%M:%S") + "+00";
+        return;
+      }
+
       result = {reinterpret_cast<const char*>(text_ptr), static_cast<std::string::size_type>(byte_count)};
     }
 
-    void getValue(const std::string_view name, std::vector<uint8_t>& result) override {
-      auto col = columnIndex(name);
+    // temporal columns decode the same from both formats, other columns are parsed from their text
+    void getValue(int col, orm::date& result) override {
+      if (PQftype(&*_native_resultset, col) != types::_date) {
+        return db::datasource::resultset::getValue(col, result);
+      }
+
+      result = (std::time_t)(detail::epoch_offset + getInteger(col) * 86400);
+    }
+
+    void getValue(int col, orm::time& result) override {
+      if (PQftype(&*_native_resultset, col) != types::_time) {
+        return db::datasource::resultset::getValue(col, result);
+      }
+
+      result = (std::time_t)(getInteger(col) / 1000000);
+    }
+
+    void getValue(int col, orm::datetime& result) override {
+      auto type = PQftype(&*_native_resultset, col);
+      if (type != types::_timestamp && type != types::_timestamptz) {
+        return db::datasource::resultset::getValue(col, result);
+      }
+
+      result = (std::time_t)(detail::epoch_offset + getInteger(col) / 1000000);
+    }
+
+    void getValue(int col, std::vector<uint8_t>& result) override {
       auto blob_ptr = PQgetvalue(&*_native_resultset, _row, col);
       auto byte_count = PQgetlength(&*_native_resultset, _row, col);
+
+      if (!isBinary(col) && PQftype(&*_native_resultset, col) == types::_bytea) {
+        result = detail::parseBytea(blob_ptr, byte_count);
+        return;
+      }
+
       auto bytes_ptr = reinterpret_cast<const uint8_t*>(blob_ptr);
 
       result = {bytes_ptr, bytes_ptr + byte_count};
     }
 
-    void getValue(const std::string_view name, const void** result) {
-      *result = (const void*)PQgetvalue(&*_native_resultset, _row, columnIndex(name));
+    void getValue(int col, const void** result) {
+      *result = (const void*)PQgetvalue(&*_native_resultset, _row, col);
     }
 
     int columnCount() override {
@@ -142,8 +532,51 @@ public:
       return PQfname(&*_native_resultset, i);
     }
 
-    int columnIndex(const std::string_view name) {
-      return PQfnumber(&*_native_resultset, name.data());
+    int columnIndex(const std::string_view name) override {
+      return PQfnumber(&*_native_resultset, ((std::string)name).data());
+    }
+
+    uint64_t rowBytes() override {
+      uint64_t bytes = 0;
+
+      for (int col = 0; col < PQnfields(&*_native_resultset); col++) {
+        bytes += PQgetlength(&*_native_resultset, _row, col);
+      }
+
+      return bytes;
+    }
+
+    int rowsAffected() {
+      return std::atoi(PQcmdTuples(&*_native_resultset));
+    }
+
+    static bool canDecodeBinary(Oid type) {
+      switch (type) {
+      case types::_bool:
+      case types::_bytea:
+      case types::_char:
+      case types::_name:
+      case types::_int8:
+      case types::_int2:
+      case types::_int4:
+      case types::_text:
+      case types::_oid:
+      case types::_json:
+      case types::_float4:
+      case types::_float8:
+      case types::_unknown:
+      case types::_bpchar:
+      case types::_varchar:
+      case types::_date:
+      case types::_time:
+      case types::_timestamp:
+      case types::_timestamptz:
+      case types::_numeric:
+      case types::_uuid:
+        return true;
+      default:
+        return false;
+      }
     }
 
   private:
@@ -151,14 +584,242 @@ public:
     std::shared_ptr<PGresult> _native_resultset;
 
     int _row = -1;
+    bool _streaming = false;
+    bool _done = false;
+
+    // a single-row or chunked result is followed by more, anything else ends the query
+    void fetch() {
+      _native_resultset = {PQgetResult(&*_native_connection), &PQclear};
+
+      auto status = PQresultStatus(_native_resultset.get());
+#ifdef LIBPQ_HAS_CHUNK_MODE
+      if (_native_resultset && (status == PGRES_SINGLE_TUPLE || status == PGRES_TUPLES_CHUNK)) {
+#else
+      if (_native_resultset && status == PGRES_SINGLE_TUPLE) {
+#endif
+        return;
+      }
+
+      _done = true;
+
+      while (auto result = PQgetResult(&*_native_connection)) {
+        PQclear(result);
+      }
+
+      if (!_native_resultset) {
+        throw pq_error(_native_connection);
+      }
+
+      pq_error::assert(_native_resultset);
+    }
+
+    bool isBinary(int col) {
+      return PQfformat(&*_native_resultset, col) == 1;
+    }
+
+    // text values are converted into what the binary format holds, e.g. days or microseconds since 2000-01-01
+    int64_t getInteger(int col) {
+      auto value = PQgetvalue(&*_native_resultset, _row, col);
+      if (!isBinary(col)) {
+        switch (PQftype(&*_native_resultset, col)) {
+        case types::_bool:
+          return *value == 't';
+        case types::_char:
+          return *value;
+        case types::_date:
+          return detail::parseTimestamp(value) / 86400 / 1000000;
+        case types::_time:
+        case types::_timestamp:
+        case types::_timestamptz:
+          return detail::parseTimestamp(value);
+        default:
+          return std::atoll(value);
+        }
+      }
+
+      switch (PQftype(&*_native_resultset, col)) {
+      case types::_bool:
+      case types::_char:
+        return *value;
+      case types::_int2:
+        return (int16_t)detail::fromNetwork<uint16_t>(value);
+      case types::_int4:
+      case types::_oid:
+      case types::_date:
+        return (int32_t)detail::fromNetwork<uint32_t>(value);
+      case types::_int8:
+      case types::_time:
+      case types::_timestamp:
+      case types::_timestamptz:
+        return (int64_t)detail::fromNetwork<uint64_t>(value);
+      case types::_float4:
+      case types::_float8:
+        return (int64_t)getFloat(col);
+      case types::_numeric:
+        return std::atoll(detail::formatNumeric(value).data());
+      default:
+        return std::atoll(value);
+      }
+    }
+
+    double getFloat(int col) {
+      auto value = PQgetvalue(&*_native_resultset, _row, col);
+      if (!isBinary(col)) {
+        auto type = PQftype(&*_native_resultset, col);
+        return type == types::_bool || type == types::_char ? (double)getInteger(col) : std::atof(value);
+      }
+
+      switch (PQftype(&*_native_resultset, col)) {
+      case types::_float4:
+        return std::bit_cast<float>(detail::fromNetwork<uint32_t>(value));
+      case types::_float8:
+        return std::bit_cast<double>(detail::fromNetwork<uint64_t>(value));
+      case types::_numeric:
+        return std::atof(detail::formatNumeric(value).data());
+      case types::_bool:
+      case types::_char:
+      case types::_int2:
+      case types::_int4:
+      case types::_int8:
+      case types::_oid:
+        return (double)getInteger(col);
+      default:
+        return std::atof(value);
+      }
+    }
+
+    std::string getText(int col) {
+      auto value = PQgetvalue(&*_native_resultset, _row, col);
+      auto length = PQgetlength(&*_native_resultset, _row, col);
+
+      return detail::formatBinary(PQftype(&*_native_resultset, col), value, length);
+    }
+  };
+
+  // server-side prepared statements of one connection, keyed by their SQL text.
+  // the least recently used statement is evicted once capacity is exceeded and
+  // deallocated with the next call to takeDeallocateScript()
+  class statement_cache {
+  public:
+    struct entry {
+      std::string name;
+      int result_format = -1;
+      // the parameter types the statement was prepared with, 0 where the server inferred them
+      std::vector<Oid> param_types;
+    };
+
+    explicit statement_cache(size_t capacity = 256) : _capacity(capacity > 0 ? capacity : 1) {
+    }
+
+    statement_cache(const statement_cache&) = delete;
+
+    statement_cache& operator=(const statement_cache&) = delete;
+
+    // returns the entry for script and whether it is new, i.e. still has to be prepared
+    std::pair<entry*, bool> acquire(const std::string& script) {
+      auto search = _index.find(script);
+      if (search != _index.end()) {
+        _lru.splice(_lru.begin(), _lru, search->second);
+        return {&search->second->second, false};
+      }
+
+      _lru.emplace_front(script, entry{"s" + std::to_string(_counter++), -1, {}});
+      _index[_lru.front().first] = _lru.begin();
+
+      if (_lru.size() > _capacity) {
+        auto& last = _lru.back();
+        _evicted.emplace_back(std::move(last.second.name));
+        _index.erase(last.first);
+        _lru.pop_back();
+      }
+
+      return {&_lru.front().second, true};
+    }
+
+    entry* find(const std::string& script) {
+      auto search = _index.find(script);
+
+      return search != _index.end() ? &search->second->second : nullptr;
+    }
+
+    // forgets a statement whose prepare failed, it was never created on the server
+    void erase(const std::string& script) {
+      auto search = _index.find(script);
+      if (search != _index.end()) {
+        _lru.erase(search->second);
+        _index.erase(search);
+      }
+    }
+
+    std::string takeDeallocateScript() {
+      std::string script;
+
+      for (const auto& name : _evicted) {
+        script += "DEALLOCATE " + name + ";";
+      }
+      _evicted.clear();
+
+      script.insert(0, _deallocate);
+      _deallocate.clear();
+
+      return script;
+    }
+
+    // a DEALLOCATE refused inside an aborted transaction is sent again with the next one. other failures are
+    // not retried, a statement that is already gone would make every later DEALLOCATE fail
+    void deallocateFailed(std::string&& script, const pq_error& error) {
+      if (error.sqlState() == "25P02") {
+        _deallocate = std::move(script) + _deallocate;
+      }
+    }
+
+    // takes the column types from the description of a freshly prepared statement. every execution requests binary
+    // results if each column can be decoded without parsing, text otherwise.
+    // the resultset decodes both formats into the same values
+    void learnResultFormat(const std::string& script, const PGresult* description) {
+      auto e = find(script);
+      if (!e || e->result_format != -1) {
+        return;
+      }
+
+      e->result_format = 1;
+      for (int i = 0; i < PQnfields(description); i++) {
+        if (!resultset::canDecodeBinary(PQftype(description, i))) {
+          e->result_format = 0;
+          break;
+        }
+      }
+    }
+
+    size_t size() const noexcept {
+      return _lru.size();
+    }
+
+    size_t capacity() const noexcept {
+      return _capacity;
+    }
+
+  private:
+    using lru_list = std::list<std::pair<std::string, entry>>;
+
+    size_t _capacity;
+    uint64_t _counter = 0;
+
+    lru_list _lru;
+    std::unordered_map<std::string_view, lru_list::iterator> _index;
+    std::vector<std::string> _evicted;
+    std::string _deallocate;
   };
 
   class statement : public db::datasource::statement {
   public:
-    statement(std::shared_ptr<PGconn> native_connection, const std::string_view script)
-        : _native_connection(native_connection) {
+    friend pipeline;
+
+    // without a cache the unnamed statement is prepared again on every execution
+    statement(std::shared_ptr<PGconn> native_connection, const std::string_view script,
+        std::shared_ptr<statement_cache> cache = nullptr)
+        : _native_connection(native_connection), _cache(cache) {
       _statement = replaceNamedParams((std::string)script);
-      _statement_hash = std::to_string(std::hash<std::string>{}(_statement));
 
       resizeParams(_params_map.size());
     }
@@ -170,91 +831,219 @@ public:
       return std::make_shared<resultset>(_native_connection, pgPrepareAndExec());
     }
 
-    std::shared_ptr<PGresult> pgPrepareAndExec() {
-      if (prepared.count(_statement_hash) == 0) {
-        prepared.emplace(_statement_hash);
+    // rows are received one at a time, or fetch_size at a time with libpq 17 or newer (chunked mode), older
+    // versions ignore fetch_size. the connection can't run anything else until the resultset is exhausted or
+    // destroyed
+    std::shared_ptr<db::datasource::resultset> executeStream([[maybe_unused]] int fetch_size) override {
+      pgPrepare();
 
-        std::shared_ptr<PGresult> prep_result{PQprepare(&*_native_connection, _statement_hash.data(), _statement.data(),
-                                                  _params.size(), _param_types.data()),
-            &PQclear};
-        pq_error::assert(prep_result);
+      if (!pgSendQueryPrepared()) {
+        throw pq_error(_native_connection);
       }
 
+#ifdef LIBPQ_HAS_CHUNK_MODE
+      if (fetch_size > 1) {
+        PQsetChunkedRowsMode(&*_native_connection, fetch_size);
+      } else {
+        PQsetSingleRowMode(&*_native_connection);
+      }
+#else
+      PQsetSingleRowMode(&*_native_connection);
+#endif
+
+      return std::make_shared<resultset>(_native_connection);
+    }
+
+    std::shared_ptr<PGresult> pgPrepareAndExec() {
+      pgPrepare();
+
       std::shared_ptr<PGresult> exec_result{
-          PQexecPrepared(&*_native_connection, _statement_hash.data(), _params.size(), _param_pointers.data(),
-              _param_lengths.data(), _param_formats.data(), types::_auto),
+          PQexecPrepared(&*_native_connection, _name.data(), _params.size(), _param_pointers.data(),
+              _param_lengths.data(), _param_formats.data(), resultFormat()),
           &PQclear};
       pq_error::assert(exec_result);
 
       return exec_result;
     }
 
+    void pgPrepare() {
+      if (!pgAcquire()) {
+        return;
+      }
+
+      // the cache entry only stays once the statement exists on the server
+      try {
+        if (_cache) {
+          auto deallocate = _cache->takeDeallocateScript();
+          if (!deallocate.empty()) {
+            std::shared_ptr<PGresult> result{PQexec(&*_native_connection, deallocate.data()), &PQclear};
+
+            try {
+              pq_error::assert(result);
+            } catch (const pq_error& e) {
+              _cache->deallocateFailed(std::move(deallocate), e);
+              throw;
+            }
+          }
+        }
+
+        std::shared_ptr<PGresult> prep_result{
+            PQprepare(&*_native_connection, _name.data(), _statement.data(), _params.size(), _param_types.data()),
+            &PQclear};
+        pq_error::assert(prep_result);
+
+        if (_cache) {
+          std::shared_ptr<PGresult> description{PQdescribePrepared(&*_native_connection, _name.data()), &PQclear};
+          pq_error::assert(description);
+          pgLearnResultFormat(&*description);
+        }
+      } catch (...) {
+        pgForget();
+        throw;
+      }
+    }
+
+    // looks the statement up in the connection's cache, returns true if it still has to be prepared
+    bool pgAcquire() {
+      if (!_cache) {
+        _name.clear();
+        return true;
+      }
+
+      auto [e, created] = _cache->acquire(_statement);
+      _name = e->name;
+
+      if (created) {
+        e->param_types = _param_types;
+      } else {
+        useDeclaredTypes(e->param_types);
+      }
+
+      return created;
+    }
+
+    void pgForget() {
+      if (_cache) {
+        _cache->erase(_statement);
+      }
+    }
+
+    int pgSendPrepare() {
+      return PQsendPrepare(&*_native_connection, _name.data(), _statement.data(), _params.size(), _param_types.data());
+    }
+
+    int pgSendDescribePrepared() {
+      return PQsendDescribePrepared(&*_native_connection, _name.data());
+    }
+
+    int pgSendQueryPrepared() {
+      return PQsendQueryPrepared(&*_native_connection, _name.data(), _params.size(), _param_pointers.data(),
+          _param_lengths.data(), _param_formats.data(), resultFormat());
+    }
+
+    void pgLearnResultFormat(const PGresult* result) {
+      if (_cache) {
+        _cache->learnResultFormat(_statement, result);
+      }
+    }
+
+    const std::string& script() const noexcept {
+      return _statement;
+    }
+
+    // appends the current parameters as one tuple of a binary COPY stream
+    void pgAppendCopyTuple(std::string& buffer) const {
+      buffer += detail::toNetwork<uint16_t>(_params.size());
+
+      for (size_t i = 0; i < _params.size(); i++) {
+        if (_param_pointers[i] == nullptr) {
+          buffer += detail::toNetwork<uint32_t>(-1);
+        } else {
+          buffer += detail::toNetwork<uint32_t>(_param_lengths[i]);
+          buffer.append(_param_pointers[i], _param_lengths[i]);
+        }
+      }
+    }
+
     int executeUpdate() override {
-      pgPrepareAndExec();
+      return std::atoi(PQcmdTuples(&*pgPrepareAndExec()));
+    }
+
+    using db::datasource::statement::setParam;
+    using db::datasource::statement::setParamToNull;
+
+    int parameterIndex(const std::string_view name) override {
+      auto search = _params_map.find((std::string)name);
 
-      return -1;
+      return search != _params_map.end() ? (int)search->second : -1;
     }
 
-    void setParamToNull(const std::string_view name) override {
-      _param_pointers[pushParam(name, "", types::_auto)] = nullptr;
+    void setParamToNull(int index) override {
+      if (pushParam(index, "", types::_auto)) {
+        _param_pointers[index] = nullptr;
+      }
     }
 
-    void setParam(const std::string_view name, bool value) override {
-      pushParam(name, std::to_string(value), types::_bool);
+    void setParam(int index, bool value) override {
+      pushParam(index, std::string(1, (char)value), types::_bool, BINARY);
     }
 
-    void setParam(const std::string_view name, int value) override {
-      pushParam(name, std::to_string(value), types::_int4);
+    void setParam(int index, int value) override {
+      pushParam(index, detail::toNetwork<uint32_t>(value), types::_int4, BINARY);
     }
 
-    void setParam(const std::string_view name, int64_t value) override {
-      pushParam(name, std::to_string(value), types::_int8);
+    void setParam(int index, int64_t value) override {
+      pushParam(index, detail::toNetwork<uint64_t>(value), types::_int8, BINARY);
     }
 
 #ifdef __SIZEOF_INT128__
-    void setParam(const std::string_view name, __uint128_t value) override {
-      setParam(name, (const void*)&value, sizeof(__uint128_t));
+    // sent as a uuid in network order. the raw host-order bytes used to be sent typed as bit, columns that stored
+    // that encoding, e.g. bytea, have to be migrated to uuid
+    void setParam(int index, __uint128_t value) override {
+      pushParam(index, detail::toNetwork<__uint128_t>(value), types::_uuid, BINARY);
     }
 #endif
 
-    void setParam(const std::string_view name, double value) override {
-      pushParam(name, std::to_string(value), types::_float8);
+    void setParam(int index, double value) override {
+      pushParam(index, detail::toNetwork<uint64_t>(std::bit_cast<uint64_t>(value)), types::_float8, BINARY);
     }
 
-    void setParam(const std::string_view name, const std::string_view value) override {
-      pushParam(name, (std::string)value, types::_text);
+    void setParam(int index, const std::string_view value) override {
+      pushParam(index, (std::string)value, types::_text);
     }
 
-    void setParam(const std::string_view name, const std::vector<uint8_t>& value) override {
-      pushParam(name, (const char*)value.data(), types::_bytea, BINARY, value.size());
+    void setParam(int index, const std::vector<uint8_t>& value) override {
+      pushParam(index, std::string{value.begin(), value.end()}, types::_bytea, BINARY);
     }
 
-    void setParam(const std::string_view name, orm::date value) override {
-      pushParam(name, (std::string)value, types::_date);
+    void setParam(int index, orm::date value) override {
+      int64_t days = ((int64_t)value.value - detail::epoch_offset) / 86400;
+      pushParam(index, detail::toNetwork<uint32_t>(days), types::_date, BINARY);
     }
 
-    void setParam(const std::string_view name, orm::time value) override {
-      pushParam(name, (std::string)value, types::_time);
+    void setParam(int index, orm::time value) override {
+      int64_t micros = ((int64_t)value.value % 86400) * 1000000;
+      pushParam(index, detail::toNetwork<uint64_t>(micros), types::_time, BINARY);
     }
 
-    void setParam(const std::string_view name, orm::datetime value) override {
-      pushParam(name, (std::string)value, types::_timestamp);
+    void setParam(int index, orm::datetime value) override {
+      int64_t micros = ((int64_t)value.value - detail::epoch_offset) * 1000000;
+      pushParam(index, detail::toNetwork<uint64_t>(micros), types::_timestamp, BINARY);
     }
 
-    void setParam(const std::string_view name, const void* data, int size) {
-      pushParam(name, (const char*)data, types::_bit, BINARY, size);
+    void setParam(int index, const void* data, int size) {
+      pushParam(index, std::string{(const char*)data, (size_t)size}, types::_bytea, BINARY);
     }
 
   private:
     static constexpr int TEXT = 0;
     static constexpr int BINARY = 1;
 
-    static std::set<std::string> prepared;
-
     std::shared_ptr<PGconn> _native_connection;
+    std::shared_ptr<statement_cache> _cache;
 
     std::string _statement;
-    std::string _statement_hash;
+    std::string _name;
 
     std::unordered_map<std::string, size_t> _params_map;
 
@@ -273,22 +1062,41 @@ public:
       _param_formats.resize(n);
     }
 
-    int pushParam(std::string_view name, std::string&& value, Oid type, int format = TEXT, int size = -1) {
-      size_t i = _params_map[(std::string)name];
+    // the server keeps the parameter types of the first prepare. binary values bound with another type, or
+    // where the server inferred the type, are sent as text instead and converted by the server
+    void useDeclaredTypes(const std::vector<Oid>& declared) {
+      for (size_t i = 0; i < _params.size(); i++) {
+        if (_param_formats[i] != BINARY || (i < declared.size() && declared[i] == _param_types[i])) {
+          continue;
+        }
 
-      _params[i] = std::move(value);
-      value = _params[i];
+        _params[i] = detail::formatBinary(_param_types[i], _params[i].data(), _params[i].length());
 
-      if (size == -1) {
-        size = value.length();
+        _param_pointers[i] = _params[i].data();
+        _param_lengths[i] = _params[i].length();
+        _param_formats[i] = TEXT;
       }
+    }
+
+    int resultFormat() const {
+      auto e = _cache ? _cache->find(_statement) : nullptr;
+
+      return e && e->result_format == BINARY ? BINARY : TEXT;
+    }
+
+    bool pushParam(int i, std::string&& value, Oid type, int format = TEXT) {
+      if (i < 0 || (size_t)i >= _params.size()) {
+        return false;
+      }
+
+      _params[i] = std::move(value);
 
       _param_types[i] = type;
-      _param_pointers[i] = value.data();
-      _param_lengths[i] = size;
+      _param_pointers[i] = _params[i].data();
+      _param_lengths[i] = _params[i].length();
       _param_formats[i] = format;
 
-      return i;
+      return true;
     }
 
     std::string replaceNamedParams(std::string&& script) {
@@ -351,7 +1159,10 @@ public:
 
   class connection : public db::datasource::connection {
   public:
-    connection(const std::string_view conninfo) {
+    friend pipeline;
+
+    connection(const std::string_view conninfo, size_t statement_cache_size = 256)
+        : _statement_cache(std::make_shared<statement_cache>(statement_cache_size)) {
       _native_connection = std::shared_ptr<PGconn>{PQconnectdb(conninfo.data()), &PQfinish};
       pq_error::assert(_native_connection);
     }
@@ -360,7 +1171,7 @@ public:
     }
 
     std::shared_ptr<db::datasource::statement> prepareStatement(const std::string_view script) override {
-      return std::make_shared<statement>(_native_connection, script);
+      return std::make_shared<statement>(_native_connection, script, _statement_cache);
     }
 
     void beginTransaction() override {
@@ -375,11 +1186,23 @@ public:
       execute("ROLLBACK");
     }
 
+    bool inTransaction() override {
+      return PQtransactionStatus(&*_native_connection) != PQTRANS_IDLE;
+    }
+
+    void relaxCommitDurability() override {
+      execute("SET LOCAL synchronous_commit TO OFF");
+    }
+
     void execute(const std::string_view script) override {
       std::shared_ptr<PGresult> result{PQexec(&*_native_connection, script.data()), &PQclear};
       pq_error::assert(result);
     }
 
+    std::shared_ptr<PGconn> getNativeConnection() noexcept {
+      return _native_connection;
+    }
+
     int getVersion() override {
       execute("CREATE TABLE IF NOT EXISTS user_version (version INTEGER)");
       execute("INSERT INTO user_version SELECT 0 WHERE (SELECT count(*) FROM user_version) = 0");
@@ -405,6 +1228,10 @@ public:
       return true;
     }
 
+    size_t maxParameters() override {
+      return 65535;
+    }
+
     std::string createInsertScript(const char* table, const orm::field_info* fields, size_t fields_len) override {
       std::stringstream str;
 
@@ -556,20 +1383,635 @@ public:
       return str.str();
     }
 
+  protected:
+    std::shared_ptr<PGconn> _native_connection;
+    std::shared_ptr<statement_cache> _statement_cache;
+
+    // native_connection may still be connecting, as long as it did not fail already
+    connection(std::shared_ptr<PGconn> native_connection, size_t statement_cache_size = 256)
+        : _native_connection(native_connection),
+          _statement_cache(std::make_shared<statement_cache>(statement_cache_size)) {
+      if (PQstatus(&*_native_connection) == CONNECTION_BAD) {
+        throw pq_error(_native_connection);
+      }
+    }
+  };
+
+  // queues statements with libpq's pipeline mode and reads all results back after a single sync,
+  // so N statements cost about one round trip instead of N
+  class pipeline {
+  public:
+    // every max_pending queued commands the pipeline is synced and its results are read, so that neither side
+    // blocks on a full socket buffer. each sync ends an implicit transaction: without an explicit BEGIN a failure
+    // only rolls back the statements since the last sync. 0 disables the automatic syncs
+    explicit pipeline(std::shared_ptr<connection> conn, size_t max_pending = 1024)
+        : _native_connection(conn->_native_connection), _cache(conn->_statement_cache), _max_pending(max_pending) {
+    }
+
+    explicit pipeline(db::connection& conn, size_t max_pending = 1024)
+        : pipeline(conn.getNativeConnection<connection>(), max_pending) {
+    }
+
+    pipeline(const pipeline&) = delete;
+
+    pipeline& operator=(const pipeline&) = delete;
+
+    // errors of statements that were never synced explicitly can't be thrown from here and are logged instead
+    ~pipeline() noexcept {
+      try {
+        sync();
+      } catch (const std::exception& e) {
+        std::cerr << "unsynced pipeline error: " << e.what() << std::endl;
+      } catch (...) {
+        std::cerr << "unsynced pipeline error" << std::endl;
+      }
+    }
+
+    size_t add(statement& stmt) {
+      if (PQpipelineStatus(&*_native_connection) == PQ_PIPELINE_OFF) {
+        if (!PQenterPipelineMode(&*_native_connection)) {
+          throw pq_error(_native_connection);
+        }
+      }
+
+      // a statement prepared in this batch is executed in text format, its description only arrives with the sync
+      if (stmt.pgAcquire()) {
+        if (!stmt.pgSendPrepare() || !stmt.pgSendDescribePrepared()) {
+          stmt.pgForget();
+          throw pq_error(_native_connection);
+        }
+
+        _pending.push_back({stmt._statement, pending::PREPARE});
+        _pending.push_back({stmt._statement, pending::DESCRIBE});
+      }
+
+      if (!stmt.pgSendQueryPrepared()) {
+        throw pq_error(_native_connection);
+      }
+
+      _pending.push_back({stmt._statement, pending::QUERY});
+
+      size_t index = _results.size() + _queued;
+      _queued += 1;
+
+      // the server stops reading once its send buffer is full, so results have to be drained now and then
+      if (_max_pending > 0 && _pending.size() >= _max_pending) {
+        syncPending();
+      }
+
+      return index;
+    }
+
+    size_t add(db::statement& stmt) {
+      return add(*stmt.getNativeStatement<statement>());
+    }
+
+    std::vector<std::shared_ptr<resultset>> sync() {
+      if (PQpipelineStatus(&*_native_connection) == PQ_PIPELINE_OFF) {
+        return {};
+      }
+
+      syncPending();
+
+      if (!PQexitPipelineMode(&*_native_connection)) {
+        throw pq_error(_native_connection);
+      }
+
+      auto results = std::move(_results);
+      _results.clear();
+
+      if (_error) {
+        throw pq_error(*std::exchange(_error, std::nullopt));
+      }
+
+      return results;
+    }
+
   private:
+    struct pending {
+      enum kind_t { PREPARE, DESCRIBE, QUERY };
+
+      std::string script;
+      kind_t kind;
+    };
+
     std::shared_ptr<PGconn> _native_connection;
+    std::shared_ptr<statement_cache> _cache;
+    size_t _max_pending;
+
+    std::vector<pending> _pending;
+    size_t _queued = 0;
+
+    std::vector<std::shared_ptr<resultset>> _results;
+    std::optional<std::string> _error;
+
+    void syncPending() {
+      try {
+        readPending();
+      } catch (...) {
+        discardPending();
+        throw;
+      }
+    }
+
+    void readPending() {
+      if (!PQpipelineSync(&*_native_connection)) {
+        throw pq_error(_native_connection);
+      }
+
+      for (const auto& entry : _pending) {
+        std::shared_ptr<PGresult> result{PQgetResult(&*_native_connection), &PQclear};
+        if (!result) {
+          throw pq_error(_native_connection);
+        }
+
+        auto status = PQresultStatus(&*result);
+        bool failed = status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK;
+
+        if (failed && status != PGRES_PIPELINE_ABORTED && !_error) {
+          _error = "pipeline statement #" + std::to_string(_results.size()) + ": " + PQresultErrorMessage(&*result);
+        }
+
+        if (entry.kind == pending::PREPARE) {
+          if (failed) {
+            _cache->erase(entry.script);
+          }
+        } else if (entry.kind == pending::DESCRIBE) {
+          if (!failed) {
+            _cache->learnResultFormat(entry.script, &*result);
+          }
+        } else {
+          _results.emplace_back(std::make_shared<resultset>(_native_connection, result));
+        }
+
+        // every queued command is terminated by a null result
+        PQgetResult(&*_native_connection);
+      }
+
+      std::shared_ptr<PGresult> sync_result{PQgetResult(&*_native_connection), &PQclear};
+      if (!sync_result || PQresultStatus(&*sync_result) != PGRES_PIPELINE_SYNC) {
+        throw pq_error(_native_connection);
+      }
+
+      _pending.clear();
+      _queued = 0;
+    }
+
+    // after a failed sync: skips the results that are left, leaves pipeline mode and forgets the statements whose
+    // prepare may not have run, so that the connection can be used again
+    void discardPending() noexcept {
+      for (const auto& entry : _pending) {
+        if (entry.kind == pending::PREPARE) {
+          _cache->erase(entry.script);
+        }
+      }
+
+      _pending.clear();
+      _queued = 0;
+      _results.clear();
+
+      if (PQstatus(&*_native_connection) != CONNECTION_OK) {
+        return;
+      }
+
+      PQpipelineSync(&*_native_connection);
+
+      // the results of each command end with a null result, a null right after another one or after a sync
+      // means nothing is left to read
+      bool ended = false;
+      while (true) {
+        PGresult* result = PQgetResult(&*_native_connection);
+        if (!result) {
+          if (ended) {
+            break;
+          }
+
+          ended = true;
+          continue;
+        }
+
+        ended = PQresultStatus(result) == PGRES_PIPELINE_SYNC;
+        PQclear(result);
+      }
+
+      PQexitPipelineMode(&*_native_connection);
+    }
   };
 
-  datasource(const std::string_view conninfo) : _conninfo(conninfo) {
+  datasource(const std::string_view conninfo, size_t statement_cache_size = 256)
+      : _conninfo(conninfo), _statement_cache_size(statement_cache_size) {
   }
 
   std::shared_ptr<db::datasource::connection> getConnection() override {
-    return std::make_shared<connection>(_conninfo);
+    return std::make_shared<connection>(_conninfo, _statement_cache_size);
   }
 
 private:
   std::string _conninfo;
+  size_t _statement_cache_size;
+};
+
+namespace detail {
+// signature, flags and header extension length of the binary COPY format
+constexpr std::string_view copy_header{"PGCOPY\n\377\r\n\0\0\0\0\0\0\0\0\0", 19};
+
+inline std::string copyColumns(const orm::field_info* fields, size_t fields_len) {
+  std::string result;
+
+  for (size_t i = 0; i < fields_len; i++) {
+    if (i > 0) {
+      result += ", ";
+    }
+
+    result += fields[i].name;
+  }
+
+  return result;
+}
+
+// a single tuple of a binary COPY stream, values are decoded by the requested type
+class copy_resultset final : public db::datasource::resultset {
+public:
+  copy_resultset(const orm::field_info* fields, size_t fields_len) : _fields(fields), _values(fields_len) {
+  }
+
+  bool next() override {
+    return false;
+  }
+
+  using db::datasource::resultset::getValue;
+  using db::datasource::resultset::isValueNull;
+
+  void getValues(const binding* bindings, size_t len, void* const* targets, bool* nulls) override {
+    db::datasource::resultset::getValues(*this, bindings, len, targets, nulls);
+  }
+
+  int columnIndex(const std::string_view name) override {
+    for (size_t i = 0; i < _values.size(); i++) {
+      if (name == _fields[i].name) {
+        return i;
+      }
+    }
+
+    return -1;
+  }
+
+  bool isValueNull(int col) override {
+    return col < 0 || _values[col].data() == nullptr;
+  }
+
+  void getValue(int col, bool& result) override {
+    result = _values[col][0] != 0;
+  }
+
+  void getValue(int col, int& result) override {
+    result = (int)getInteger(_values[col]);
+  }
+
+  void getValue(int col, int64_t& result) override {
+    result = getInteger(_values[col]);
+  }
+
+#ifdef __SIZEOF_INT128__
+  void getValue(int col, __uint128_t& result) override {
+    result = fromNetwork<__uint128_t>(_values[col].data());
+  }
+#endif
+
+  void getValue(int col, double& result) override {
+    auto bytes = _values[col];
+
+    if (bytes.length() == 4) {
+      result = std::bit_cast<float>(fromNetwork<uint32_t>(bytes.data()));
+    } else {
+      result = std::bit_cast<double>(fromNetwork<uint64_t>(bytes.data()));
+    }
+  }
+
+  void getValue(int col, std::string& result) override {
+    result = _values[col];
+  }
+
+  void getValue(int col, std::vector<uint8_t>& result) override {
+    auto bytes = _values[col];
+    result = {bytes.begin(), bytes.end()};
+  }
+
+  void getValue(int col, orm::date& result) override {
+    auto days = (int32_t)fromNetwork<uint32_t>(_values[col].data());
+    result = (std::time_t)(epoch_offset + (int64_t)days * 86400);
+  }
+
+  void getValue(int col, orm::time& result) override {
+    result = (std::time_t)(getInteger(_values[col]) / 1000000);
+  }
+
+  void getValue(int col, orm::datetime& result) override {
+    result = (std::time_t)(epoch_offset + getInteger(_values[col]) / 1000000);
+  }
+
+  int columnCount() override {
+    return _values.size();
+  }
+
+  std::string columnName(int i) override {
+    return _fields[i].name;
+  }
+
+  // returns the number of bytes consumed or 0 if the tuple is incomplete
+  size_t parse(std::string_view buffer) {
+    size_t offset = 2;
+
+    for (auto& field : _values) {
+      if (buffer.length() < offset + 4) {
+        return 0;
+      }
+
+      auto length = (int32_t)fromNetwork<uint32_t>(buffer.data() + offset);
+      offset += 4;
+
+      if (length < 0) {
+        field = {};
+        continue;
+      }
+
+      if (buffer.length() < offset + length) {
+        return 0;
+      }
+
+      field = buffer.substr(offset, length);
+      offset += length;
+    }
+
+    return offset;
+  }
+
+private:
+  const orm::field_info* _fields;
+  std::vector<std::string_view> _values;
+
+  static int64_t getInteger(std::string_view bytes) {
+    switch (bytes.length()) {
+    case 2:
+      return (int16_t)fromNetwork<uint16_t>(bytes.data());
+    case 4:
+      return (int32_t)fromNetwork<uint32_t>(bytes.data());
+    default:
+      return (int64_t)fromNetwork<uint64_t>(bytes.data());
+    }
+  }
+};
+} // namespace detail
+
+// encodes objects as binary COPY tuples using the same parameter encoding as an INSERT,
+// so the table's column types have to match the field types exactly
+template <typename T>
+class copy_encoder {
+public:
+  using meta = db::orm::meta<T>;
+
+  explicit copy_encoder(db::connection& conn, const std::string_view table = meta::class_name) : _statement(conn) {
+    auto fields = (const db::orm::field_info*)&meta::class_members;
+    auto fields_len = sizeof(meta::class_members) / sizeof(db::orm::field_info);
+
+    _statement.prepare(conn.getNativeConnection()->createInsertScript(((std::string)table).data(), fields, fields_len));
+    _native_statement = _statement.getNativeStatement<datasource::statement>();
+
+    _script = "COPY \"" + (std::string)table + "\" (" + detail::copyColumns(fields, fields_len) +
+        ") FROM STDIN (FORMAT binary)";
+    _buffer = detail::copy_header;
+  }
+
+  const std::string& script() const noexcept {
+    return _script;
+  }
+
+  void encode(const T& source) {
+    meta::serialize(_statement, source);
+    _native_statement->pgAppendCopyTuple(_buffer);
+  }
+
+  void finish() {
+    _buffer += detail::toNetwork<uint16_t>(-1);
+  }
+
+  std::string& buffer() noexcept {
+    return _buffer;
+  }
+
+private:
+  db::statement _statement;
+  std::shared_ptr<datasource::statement> _native_statement;
+
+  std::string _script;
+  std::string _buffer;
+};
+
+// decodes binary COPY tuples, the query has to select the fields of T in declaration order
+template <typename T>
+class copy_decoder {
+public:
+  using meta = db::orm::meta<T>;
+
+  static constexpr size_t fields_len = sizeof(meta::class_members) / sizeof(db::orm::field_info);
+
+  explicit copy_decoder(const std::string_view query = "")
+      : _tuple(std::make_shared<detail::copy_resultset>(meta::class_members, fields_len)), _resultset(_tuple),
+        _reader(_resultset) {
+    auto fields = (const db::orm::field_info*)&meta::class_members;
+
+    if (query.empty()) {
+      _script = "COPY (SELECT " + detail::copyColumns(fields, fields_len) + " FROM \"" + meta::class_name +
+          "\") TO STDOUT (FORMAT binary)";
+    } else {
+      _script = "COPY (" + (std::string)query + ") TO STDOUT (FORMAT binary)";
+    }
+  }
+
+  const std::string& script() const noexcept {
+    return _script;
+  }
+
+  // returns the number of decoded objects
+  size_t decode(std::string_view chunk, const std::function<void(T&)>& cb) {
+    _buffer.append(chunk);
+
+    std::string_view pending = _buffer;
+    size_t count = 0;
+
+    if (!_header_read) {
+      if (pending.length() < detail::copy_header.length()) {
+        return 0;
+      }
+
+      auto extension = detail::fromNetwork<uint32_t>(pending.data() + 15);
+      if (pending.length() < detail::copy_header.length() + extension) {
+        return 0;
+      }
+
+      pending.remove_prefix(detail::copy_header.length() + extension);
+      _header_read = true;
+    }
+
+    while (pending.length() >= 2) {
+      auto tuple_fields = (int16_t)detail::fromNetwork<uint16_t>(pending.data());
+      if (tuple_fields < 0) {
+        pending = {};
+        break;
+      }
+
+      if ((size_t)tuple_fields != fields_len) {
+        throw pq_error("COPY returned " + std::to_string(tuple_fields) + " columns, expected " +
+            std::to_string(fields_len));
+      }
+
+      size_t length = _tuple->parse(pending);
+      if (length == 0) {
+        break;
+      }
+
+      T result;
+      _reader.read(result);
+      cb(result);
+
+      pending.remove_prefix(length);
+      count += 1;
+    }
+
+    _buffer.erase(0, _buffer.length() - pending.length());
+
+    return count;
+  }
+
+private:
+  std::shared_ptr<detail::copy_resultset> _tuple;
+  db::resultset _resultset;
+  db::orm::row_reader<T> _reader;
+  std::string _script;
+  std::string _buffer;
+  bool _header_read = false;
+};
+
+// streams objects into a table with COPY ... FROM STDIN, data is sent in chunks of buffer_size bytes
+template <typename T>
+class copy_writer {
+public:
+  explicit copy_writer(db::connection& conn, const std::string_view table = db::orm::meta<T>::class_name,
+      size_t buffer_size = 65536)
+      : _encoder(conn, table), _buffer_size(buffer_size) {
+    _native_connection = conn.getNativeConnection<datasource::connection>()->getNativeConnection();
+
+    std::shared_ptr<PGresult> result{PQexec(&*_native_connection, _encoder.script().data()), &PQclear};
+    if (PQresultStatus(&*result) != PGRES_COPY_IN) {
+      throw pq_error(result);
+    }
+  }
+
+  copy_writer(const copy_writer&) = delete;
+
+  copy_writer& operator=(const copy_writer&) = delete;
+
+  ~copy_writer() noexcept {
+    if (_finished) {
+      return;
+    }
+
+    PQputCopyEnd(&*_native_connection, "copy_writer destroyed before finish()");
+    while (auto result = PQgetResult(&*_native_connection)) {
+      PQclear(result);
+    }
+  }
+
+  void write(const T& source) {
+    _encoder.encode(source);
+
+    if (_encoder.buffer().length() >= _buffer_size) {
+      flush();
+    }
+  }
+
+  // returns the number of copied rows
+  int64_t finish() {
+    _encoder.finish();
+    flush();
+
+    if (PQputCopyEnd(&*_native_connection, nullptr) != 1) {
+      throw pq_error(_native_connection);
+    }
+
+    // from here on the copy ended, the destructor must not abort it
+    _finished = true;
+
+    std::shared_ptr<PGresult> result{PQgetResult(&*_native_connection), &PQclear};
+    while (auto next = PQgetResult(&*_native_connection)) {
+      PQclear(next);
+    }
+
+    pq_error::assert(result);
+
+    return std::atoll(PQcmdTuples(&*result));
+  }
+
+private:
+  copy_encoder<T> _encoder;
+  size_t _buffer_size;
+  std::shared_ptr<PGconn> _native_connection;
+  bool _finished = false;
+
+  void flush() {
+    auto& buffer = _encoder.buffer();
+
+    if (PQputCopyData(&*_native_connection, buffer.data(), buffer.length()) != 1) {
+      throw pq_error(_native_connection);
+    }
+
+    buffer.clear();
+  }
 };
 
-std::set<std::string> datasource::statement::prepared;
+// streams the rows of COPY ... TO STDOUT into cb, returns the number of rows
+template <typename T>
+int64_t copyOut(db::connection& conn, const std::function<void(T&)>& cb, const std::string_view query = "") {
+  auto native_connection = conn.getNativeConnection<datasource::connection>()->getNativeConnection();
+  copy_decoder<T> decoder{query};
+
+  std::shared_ptr<PGresult> result{PQexec(&*native_connection, decoder.script().data()), &PQclear};
+  if (PQresultStatus(&*result) != PGRES_COPY_OUT) {
+    throw pq_error(result);
+  }
+
+  char* buf;
+  int length;
+  while ((length = PQgetCopyData(&*native_connection, &buf, 0)) > 0) {
+    std::unique_ptr<char, decltype(&PQfreemem)> chunk{buf, &PQfreemem};
+
+    try {
+      decoder.decode({buf, (size_t)length}, cb);
+    } catch (...) {
+      // the rest of the stream has to be read before the connection can be used again
+      while (PQgetCopyData(&*native_connection, &buf, 0) > 0) {
+        PQfreemem(buf);
+      }
+      while (auto next = PQgetResult(&*native_connection)) {
+        PQclear(next);
+      }
+
+      throw;
+    }
+  }
+
+  if (length == -2) {
+    throw pq_error(native_connection);
+  }
+
+  result = {PQgetResult(&*native_connection), &PQclear};
+  while (auto next = PQgetResult(&*native_connection)) {
+    PQclear(next);
+  }
+
+  pq_error::assert(result);
+
+  return std::atoll(PQcmdTuples(&*result));
+}
+
 } // namespace db::pq
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "./db-sqlite.hpp"
+#include "./db-pool-uv.hpp"
+#include "./db/connection.hpp"
+#include "./task.hpp"
+#include "./uvpp/work.hpp"
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+namespace db::sqlite {
+// runs fn with a connection of dsrc. with CMAKE_ENABLE_THREADING it runs on the libuv threadpool, where opening
+// the connection blocks a worker instead of the loop, otherwise it runs inline. the lambdas are named because gcc
+// destroys capturing temporaries inside co_await twice
+template <typename F, typename T = std::invoke_result_t<F, db::connection&>>
+task<T> runAsync(db::datasource& dsrc, F fn, uv_loop_t* native_loop = uv_default_loop()) {
+  if constexpr (std::is_void_v<T>) {
+    auto wrapped = [fn](db::connection& conn) {
+      fn(conn);
+      return true;
+    };
+
+    co_await runAsync(dsrc, wrapped, native_loop);
+  } else {
+#ifdef CMAKE_ENABLE_THREADING
+    std::function<T()> work = [&dsrc, fn]() {
+      db::connection conn(dsrc);
+      return fn(conn);
+    };
+
+    co_return co_await uv::work::queue<T>(work, native_loop);
+#else
+    db::connection conn(dsrc);
+    co_return fn(conn);
+#endif
+  }
+}
+
+// like runAsync above, but waits for a connection of pool on the loop and only then queues fn, so that callers
+// waiting for a busy pool don't hold threadpool workers
+template <typename F, typename T = std::invoke_result_t<F, db::connection&>>
+task<T> runAsync(db::pooled::datasource& pool, F fn, uv_loop_t* native_loop = uv_default_loop()) {
+  if constexpr (std::is_void_v<T>) {
+    auto wrapped = [fn](db::connection& conn) {
+      fn(conn);
+      return true;
+    };
+
+    co_await runAsync(pool, wrapped, native_loop);
+  } else {
+#ifdef CMAKE_ENABLE_THREADING
+    auto native = co_await db::pooled::getConnectionAsync(pool, native_loop);
+
+    std::function<T()> work = [&pool, native, fn]() {
+      db::connection conn(pool, native);
+      return fn(conn);
+    };
+
+    co_return co_await uv::work::queue<T>(work, native_loop);
+#else
+    db::connection conn(pool);
+    co_return fn(conn);
+#endif
+  }
+}
+
+// reads share the reader connections of the pool and run in parallel
+template <typename F, typename T = std::invoke_result_t<F, db::connection&>>
+task<T> readAsync(rw_datasource& dsrc, F fn, uv_loop_t* native_loop = uv_default_loop()) {
+  return runAsync(dsrc.reader(), std::move(fn), native_loop);
+}
+
+// writes queue up for the single writer connection
+template <typename F, typename T = std::invoke_result_t<F, db::connection&>>
+task<T> writeAsync(rw_datasource& dsrc, F fn, uv_loop_t* native_loop = uv_default_loop()) {
+  return runAsync(dsrc.writer(), std::move(fn), native_loop);
+}
+} // namespace db::sqlite
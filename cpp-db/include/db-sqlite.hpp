@@ -2,8 +2,14 @@
 
 #include "./db/connection.hpp"
 #include "./db/datasource.hpp"
+#include "./db/pool.hpp"
 #include "sqlite3.h"
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <optional>
 #include <sstream>
+#include <unordered_map>
 
 namespace db::sqlite {
 class sqlite3_error : public db::sql_error {
@@ -32,7 +38,32 @@ public:
 
 class datasource : public db::datasource {
 public:
-  class resultset : public db::datasource::resultset {
+  // settings applied to every connection as it is opened, unset ones keep sqlite's defaults
+  struct pragmas {
+    std::string journal_mode;
+    std::string synchronous;
+    std::string temp_store;
+    std::optional<int64_t> mmap_size;
+    // pages if positive, KiB if negative
+    std::optional<int64_t> cache_size;
+    std::optional<int> busy_timeout_ms;
+
+    // WAL lets readers run next to the writer, synchronous=NORMAL only syncs on checkpoints in WAL mode,
+    // so a power loss may undo the latest commits but never corrupts the database
+    static pragmas highThroughput() {
+      pragmas settings;
+      settings.journal_mode = "WAL";
+      settings.synchronous = "NORMAL";
+      settings.temp_store = "MEMORY";
+      settings.mmap_size = int64_t{256} << 20;
+      settings.cache_size = -65536;
+      settings.busy_timeout_ms = 5000;
+
+      return settings;
+    }
+  };
+
+  class resultset final : public db::datasource::resultset {
   public:
     resultset(std::shared_ptr<sqlite3> native_connection, std::shared_ptr<sqlite3_stmt> native_statement)
         : _native_connection(native_connection), _native_statement(native_statement) {
@@ -40,12 +71,14 @@ public:
         throw sqlite3_error(_native_connection);
       }
 
-      for (int i = 0, col_count = sqlite3_data_count(&*_native_statement); i < col_count; i++) {
+      for (int i = 0, col_count = sqlite3_column_count(&*_native_statement); i < col_count; i++) {
         _cols[sqlite3_column_name(&*_native_statement, i)] = i;
       }
     }
 
+    // the statement may be bound again once its rows are no longer read
     virtual ~resultset() override {
+      sqlite3_reset(&*_native_statement);
     }
 
     bool next() override {
@@ -57,48 +90,54 @@ public:
       }
     }
 
-    bool isValueNull(const std::string_view name) override {
-      return sqlite3_column_type(&*_native_statement, _cols[(std::string)name]) == SQLITE_NULL;
+    using db::datasource::resultset::getValue;
+    using db::datasource::resultset::isValueNull;
+
+    void getValues(const binding* bindings, size_t len, void* const* targets, bool* nulls) override {
+      db::datasource::resultset::getValues(*this, bindings, len, targets, nulls);
     }
 
-    void getValue(const std::string_view name, bool& result) override {
-      result = sqlite3_column_int(&*_native_statement, _cols[(std::string)name]) != 0;
+    int columnIndex(const std::string_view name) override {
+      auto it = _cols.find((std::string)name);
+      return it != _cols.end() ? it->second : -1;
     }
 
-    bool getValue(int col, int& result) {
-      result = sqlite3_column_int(&*_native_statement, col);
+    bool isValueNull(int col) override {
+      return col < 0 || sqlite3_column_type(&*_native_statement, col) == SQLITE_NULL;
     }
 
-    void getValue(const std::string_view name, int& result) override {
-      getValue(_cols[(std::string)name], result);
+    void getValue(int col, bool& result) override {
+      result = sqlite3_column_int(&*_native_statement, col) != 0;
     }
 
-    void getValue(const std::string_view name, int64_t& result) override {
-      result = sqlite3_column_int64(&*_native_statement, _cols[(std::string)name]);
+    void getValue(int col, int& result) override {
+      result = sqlite3_column_int(&*_native_statement, col);
+    }
+
+    void getValue(int col, int64_t& result) override {
+      result = sqlite3_column_int64(&*_native_statement, col);
     }
 
 #ifdef __SIZEOF_INT128__
-    void getValue(const std::string_view name, __uint128_t& result) override {
+    void getValue(int col, __uint128_t& result) override {
       const void* bytes;
-      getValue<sizeof(__uint128_t)>(name, &bytes);
+      getValue<sizeof(__uint128_t)>(col, &bytes);
       result = *(__uint128_t*)bytes;
     }
 #endif
 
-    void getValue(const std::string_view name, double& result) override {
-      result = sqlite3_column_double(&*_native_statement, _cols[(std::string)name]);
+    void getValue(int col, double& result) override {
+      result = sqlite3_column_double(&*_native_statement, col);
     }
 
-    void getValue(const std::string_view name, std::string& result) override {
-      auto col = _cols[(std::string)name];
+    void getValue(int col, std::string& result) override {
       auto text_ptr = sqlite3_column_text(&*_native_statement, col);
       auto byte_count = sqlite3_column_bytes(&*_native_statement, col);
 
       result = {reinterpret_cast<const char*>(text_ptr), static_cast<std::string::size_type>(byte_count)};
     }
 
-    void getValue(const std::string_view name, std::vector<uint8_t>& result) override {
-      auto col = _cols[(std::string)name];
+    void getValue(int col, std::vector<uint8_t>& result) override {
       auto blob_ptr = sqlite3_column_blob(&*_native_statement, col);
       auto byte_count = sqlite3_column_bytes(&*_native_statement, col);
       auto bytes_ptr = static_cast<const uint8_t*>(blob_ptr);
@@ -107,8 +146,7 @@ public:
     }
 
     template <std::size_t N>
-    void getValue(const std::string_view name, const void** result) {
-      auto col = _cols[(std::string)name];
+    void getValue(int col, const void** result) {
       auto blob_ptr = sqlite3_column_blob(&*_native_statement, col);
 
       *result = blob_ptr;
@@ -131,6 +169,97 @@ public:
     bool _first_row = true;
   };
 
+  // idle prepared statements of one connection, keyed by their SQL text.
+  // statements handed out by acquire() return here once their last reference is gone,
+  // the least recently used ones are finalized once capacity is exceeded
+  class statement_cache : public std::enable_shared_from_this<statement_cache> {
+  public:
+    explicit statement_cache(size_t capacity = 256) : _capacity(capacity) {
+    }
+
+    statement_cache(const statement_cache&) = delete;
+
+    statement_cache& operator=(const statement_cache&) = delete;
+
+    ~statement_cache() noexcept {
+      for (auto& [script, native_statement] : _lru) {
+        sqlite3_finalize(native_statement);
+      }
+    }
+
+    std::shared_ptr<sqlite3_stmt> acquire(std::shared_ptr<sqlite3> native_connection, const std::string_view script) {
+      std::string key{script};
+      sqlite3_stmt* native_statement = nullptr;
+
+      auto search = _index.find(key);
+      if (search != _index.end()) {
+        native_statement = search->second->second;
+        _lru.erase(search->second);
+        _index.erase(search);
+
+        _hits += 1;
+      } else {
+        sqlite3_error::assert(
+            sqlite3_prepare_v2(&*native_connection, script.data(), script.length() + 1, &native_statement, nullptr),
+            native_connection);
+
+        _misses += 1;
+      }
+
+      auto release = [cache = weak_from_this(), key = std::move(key)](sqlite3_stmt* native_statement) mutable {
+        if (auto c = cache.lock()) {
+          c->release(std::move(key), native_statement);
+        } else {
+          sqlite3_finalize(native_statement);
+        }
+      };
+
+      return {native_statement, std::move(release)};
+    }
+
+    size_t size() const noexcept {
+      return _lru.size();
+    }
+
+    size_t hits() const noexcept {
+      return _hits;
+    }
+
+    size_t misses() const noexcept {
+      return _misses;
+    }
+
+  private:
+    using lru_list = std::list<std::pair<std::string, sqlite3_stmt*>>;
+
+    size_t _capacity;
+    size_t _hits = 0;
+    size_t _misses = 0;
+
+    lru_list _lru;
+    std::unordered_map<std::string_view, lru_list::iterator> _index;
+
+    void release(std::string&& script, sqlite3_stmt* native_statement) {
+      sqlite3_reset(native_statement);
+      sqlite3_clear_bindings(native_statement);
+
+      // the same script may have been checked out twice, one idle copy is enough
+      if (_capacity == 0 || _index.count(script) != 0) {
+        sqlite3_finalize(native_statement);
+        return;
+      }
+
+      _lru.emplace_front(std::move(script), native_statement);
+      _index[_lru.front().first] = _lru.begin();
+
+      if (_lru.size() > _capacity) {
+        sqlite3_finalize(_lru.back().second);
+        _index.erase(_lru.back().first);
+        _lru.pop_back();
+      }
+    }
+  };
+
   class statement : public db::datasource::statement {
   public:
     statement(std::shared_ptr<sqlite3> native_connection, const std::string_view script)
@@ -143,94 +272,97 @@ public:
       _native_statement = {statement, &sqlite3_finalize};
     }
 
+    statement(std::shared_ptr<sqlite3> native_connection, const std::string_view script, statement_cache& cache)
+        : _native_connection(native_connection), _native_statement(cache.acquire(native_connection, script)) {
+    }
+
     virtual ~statement() override {
     }
 
+    // a statement is reset around each execution so it can be bound and run again, its bindings are kept
     std::shared_ptr<db::datasource::resultset> execute() override {
+      sqlite3_reset(&*_native_statement);
+
       return std::make_shared<resultset>(_native_connection, _native_statement);
     }
 
     int executeUpdate() override {
-      if (sqlite3_step(&*_native_statement) == SQLITE_ERROR) {
+      sqlite3_reset(&*_native_statement);
+
+      auto code = sqlite3_step(&*_native_statement);
+      sqlite3_reset(&*_native_statement);
+
+      if (code != SQLITE_DONE && code != SQLITE_ROW) {
         throw sqlite3_error(_native_connection);
       }
 
       return sqlite3_changes(&*_native_connection);
     }
 
-    void setParamToNull(const std::string_view name) override {
-      int index = sqlite3_bind_parameter_index(&*_native_statement, name.data());
+    using db::datasource::statement::setParam;
+    using db::datasource::statement::setParamToNull;
 
-      if (index != 0) {
-        sqlite3_error::assert(sqlite3_bind_null(&*_native_statement, index), _native_connection);
-      }
+    int parameterIndex(const std::string_view name) override {
+      return sqlite3_bind_parameter_index(&*_native_statement, ((std::string)name).data()) - 1;
     }
 
-    void setParam(const std::string_view name, bool value) override {
-      int index = sqlite3_bind_parameter_index(&*_native_statement, name.data());
-
-      if (index != 0) {
-        sqlite3_error::assert(sqlite3_bind_int(&*_native_statement, index, value), _native_connection);
+    void setParamToNull(int index) override {
+      if (index >= 0) {
+        sqlite3_error::assert(sqlite3_bind_null(&*_native_statement, index + 1), _native_connection);
       }
     }
 
-    void setParam(const std::string_view name, int value) override {
-      int index = sqlite3_bind_parameter_index(&*_native_statement, name.data());
-
-      if (index != 0) {
-        sqlite3_error::assert(sqlite3_bind_int(&*_native_statement, index, value), _native_connection);
+    void setParam(int index, bool value) override {
+      if (index >= 0) {
+        sqlite3_error::assert(sqlite3_bind_int(&*_native_statement, index + 1, value), _native_connection);
       }
     }
 
-    void setParam(const std::string_view name, int64_t value) override {
-      int index = sqlite3_bind_parameter_index(&*_native_statement, name.data());
+    void setParam(int index, int value) override {
+      if (index >= 0) {
+        sqlite3_error::assert(sqlite3_bind_int(&*_native_statement, index + 1, value), _native_connection);
+      }
+    }
 
-      if (index != 0) {
-        sqlite3_error::assert(sqlite3_bind_int64(&*_native_statement, index, value), _native_connection);
+    void setParam(int index, int64_t value) override {
+      if (index >= 0) {
+        sqlite3_error::assert(sqlite3_bind_int64(&*_native_statement, index + 1, value), _native_connection);
       }
     }
 
 #ifdef __SIZEOF_INT128__
-    void setParam(const std::string_view name, __uint128_t value) override {
-      setParam<sizeof(__uint128_t)>(name, (const void*)&value);
+    void setParam(int index, __uint128_t value) override {
+      setParam<sizeof(__uint128_t)>(index, (const void*)&value);
     }
 #endif
 
-    void setParam(const std::string_view name, double value) override {
-      int index = sqlite3_bind_parameter_index(&*_native_statement, name.data());
-
-      if (index != 0) {
-        sqlite3_error::assert(sqlite3_bind_double(&*_native_statement, index, value), _native_connection);
+    void setParam(int index, double value) override {
+      if (index >= 0) {
+        sqlite3_error::assert(sqlite3_bind_double(&*_native_statement, index + 1, value), _native_connection);
       }
     }
 
-    void setParam(const std::string_view name, const std::string_view value) override {
-      int index = sqlite3_bind_parameter_index(&*_native_statement, name.data());
-
-      if (index != 0) {
+    void setParam(int index, const std::string_view value) override {
+      if (index >= 0) {
         sqlite3_error::assert(
-            sqlite3_bind_text(&*_native_statement, index, value.data(), value.length(), SQLITE_TRANSIENT),
+            sqlite3_bind_text(&*_native_statement, index + 1, value.data(), value.length(), SQLITE_TRANSIENT),
             _native_connection);
       }
     }
 
-    void setParam(const std::string_view name, const std::vector<uint8_t>& value) override {
-      int index = sqlite3_bind_parameter_index(&*_native_statement, name.data());
-
-      if (index != 0) {
-        sqlite3_error::assert(sqlite3_bind_blob(&*_native_statement, index, static_cast<const void*>(value.data()),
+    void setParam(int index, const std::vector<uint8_t>& value) override {
+      if (index >= 0) {
+        sqlite3_error::assert(sqlite3_bind_blob(&*_native_statement, index + 1, static_cast<const void*>(value.data()),
                                   value.size(), SQLITE_TRANSIENT),
             _native_connection);
       }
     }
 
     template <std::size_t N>
-    void setParam(const std::string_view name, const void* data) {
-      int index = sqlite3_bind_parameter_index(&*_native_statement, name.data());
-
-      if (index != 0) {
+    void setParam(int index, const void* data) {
+      if (index >= 0) {
         sqlite3_error::assert(
-            sqlite3_bind_blob(&*_native_statement, index, data, N, SQLITE_TRANSIENT), _native_connection);
+            sqlite3_bind_blob(&*_native_statement, index + 1, data, N, SQLITE_TRANSIENT), _native_connection);
       }
     }
 
@@ -241,18 +373,23 @@ public:
 
   class connection : public db::datasource::connection {
   public:
-    connection(const std::string_view filename, int flags) {
+    connection(const std::string_view filename, int flags, size_t statement_cache_size = 256,
+        const pragmas& settings = {})
+        : _statement_cache(std::make_shared<statement_cache>(statement_cache_size)) {
       sqlite3* connection = nullptr;
-      sqlite3_error::assert(sqlite3_open_v2(filename.data(), &connection, flags, nullptr), _native_connection);
+      int code = sqlite3_open_v2(filename.data(), &connection, flags, nullptr);
 
       _native_connection = {connection, &sqlite3_close};
+      sqlite3_error::assert(code, _native_connection);
+
+      apply(settings);
     }
 
     virtual ~connection() override {
     }
 
     std::shared_ptr<db::datasource::statement> prepareStatement(const std::string_view script) override {
-      return std::make_shared<statement>(_native_connection, script);
+      return std::make_shared<statement>(_native_connection, script, *_statement_cache);
     }
 
     void beginTransaction() override {
@@ -267,6 +404,14 @@ public:
       execute("ROLLBACK");
     }
 
+    bool inTransaction() override {
+      return !sqlite3_get_autocommit(&*_native_connection);
+    }
+
+    bool cheapSavepoints() override {
+      return true;
+    }
+
     void execute(const std::string_view script) override {
       char* errmsg = nullptr;
       int code = sqlite3_exec(&*_native_connection, script.data(), nullptr, nullptr, &errmsg);
@@ -297,6 +442,10 @@ public:
       return true;
     }
 
+    size_t maxParameters() override {
+      return sqlite3_limit(&*_native_connection, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+    }
+
     std::string createInsertScript(const char* table, const orm::field_info* fields, size_t fields_len) override {
       std::stringstream str;
 
@@ -450,20 +599,104 @@ public:
 
   public:
     std::shared_ptr<sqlite3> _native_connection;
+    // destroyed before _native_connection so idle statements are finalized before the database is closed
+    std::shared_ptr<statement_cache> _statement_cache;
+
+  private:
+    void apply(const pragmas& settings) {
+      if (settings.busy_timeout_ms) {
+        sqlite3_error::assert(
+            sqlite3_busy_timeout(&*_native_connection, *settings.busy_timeout_ms), _native_connection);
+      }
+
+      // journal_mode is a property of the database file, read-only connections leave it to the writer
+      if (!settings.journal_mode.empty() && !sqlite3_db_readonly(&*_native_connection, "main")) {
+        execute("PRAGMA journal_mode = " + settings.journal_mode);
+      }
+
+      if (!settings.synchronous.empty()) {
+        execute("PRAGMA synchronous = " + settings.synchronous);
+      }
+
+      if (!settings.temp_store.empty()) {
+        execute("PRAGMA temp_store = " + settings.temp_store);
+      }
+
+      if (settings.mmap_size) {
+        execute("PRAGMA mmap_size = " + std::to_string(*settings.mmap_size));
+      }
+
+      if (settings.cache_size) {
+        execute("PRAGMA cache_size = " + std::to_string(*settings.cache_size));
+      }
+    }
   };
 
-  datasource(const std::string_view filename, int flags = default_flags) : _filename(filename), _flags(flags) {
+  static const int default_flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI;
+
+  datasource(const std::string_view filename, int flags = default_flags, size_t statement_cache_size = 256)
+      : _filename(filename), _flags(flags), _statement_cache_size(statement_cache_size) {
+  }
+
+  datasource(const std::string_view filename, const pragmas& settings, int flags = default_flags,
+      size_t statement_cache_size = 256)
+      : _filename(filename), _flags(flags), _statement_cache_size(statement_cache_size), _settings(settings) {
   }
 
   std::shared_ptr<db::datasource::connection> getConnection() override {
-    return std::make_shared<connection>(_filename, _flags);
+    return std::make_shared<connection>(_filename, _flags, _statement_cache_size, _settings);
   }
 
 private:
   std::string _filename;
   int _flags;
+  size_t _statement_cache_size;
+  pragmas _settings;
+};
 
-  static const int default_flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI;
+// one writer and a bounded pool of readers on the same database file. in WAL mode readers neither block the
+// writer nor each other, while the single writer connection serialises all writes. the writer is opened first
+// so that the file exists and is switched to WAL before any reader opens it
+class rw_datasource {
+public:
+  rw_datasource(const std::string_view filename, size_t readers = 4,
+      const datasource::pragmas& settings = datasource::pragmas::highThroughput())
+      : _write_source(filename, settings), _read_source(filename, settings, read_flags),
+        _writer(_write_source, writerOptions()), _reader(_read_source, readerOptions(readers)) {
+  }
+
+  db::pooled::datasource& reader() noexcept {
+    return _reader;
+  }
+
+  db::pooled::datasource& writer() noexcept {
+    return _writer;
+  }
+
+private:
+  static const int read_flags = SQLITE_OPEN_READONLY | SQLITE_OPEN_URI;
+
+  datasource _write_source;
+  datasource _read_source;
+  db::pooled::datasource _writer;
+  db::pooled::datasource _reader;
+
+  static db::pooled::options writerOptions() {
+    db::pooled::options opts;
+    opts.min_size = 1;
+    opts.max_size = 1;
+    opts.idle_timeout = {};
+    opts.max_lifetime = {};
+
+    return opts;
+  }
+
+  static db::pooled::options readerOptions(size_t readers) {
+    db::pooled::options opts;
+    opts.max_size = std::max<size_t>(readers, 1);
+
+    return opts;
+  }
 };
 
 // void configure(db::connection& _conn, int op) {
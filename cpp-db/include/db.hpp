@@ -1,6 +1,9 @@
 #pragma once
 
 #include "./db/connection.hpp"
+#include "./db/group-commit.hpp"
+#include "./db/instrumentation.hpp"
+#include "./db/kv-store.hpp"
 #include "./db/orm-repository.hpp"
 #include "./db/orm.hpp"
 #include "./db/pool.hpp"
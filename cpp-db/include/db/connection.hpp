@@ -4,6 +4,7 @@
 #include <memory>
 #include <optional>
 #include <string_view>
+#include <utility>
 
 namespace db {
 class connection {
@@ -28,6 +29,14 @@ public:
     }
   }
 
+  // wraps a connection acquired from dsrc beforehand, e.g. asynchronously from a pool
+  connection(datasource& dsrc, std::shared_ptr<datasource::connection> native)
+      : _dsrc(dsrc), _datasource_connection(std::move(native)) {
+    if (_dsrc.onConnectionOpen()) {
+      _dsrc.onConnectionOpen()(*this);
+    }
+  }
+
   connection(const connection&) = delete;
 
   connection(connection&&) = delete;
@@ -1,11 +1,14 @@
 #pragma once
 
 #include "./common.hpp"
+#include "./instrumentation.hpp"
 #include "./orm-common.hpp"
 #include <functional>
 #include <memory>
 #include <stdint.h>
+#include <string>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace db {
@@ -18,45 +21,124 @@ public:
 
     virtual bool next() = 0;
 
-    virtual bool isValueNull(const std::string_view name) = 0;
+    // returns -1 if there is no such column
+    virtual int columnIndex(const std::string_view name) = 0;
 
-    virtual void getValue(const std::string_view name, bool& result) = 0;
+    // the size of the current row as received from the server, only used for instrumentation
+    virtual uint64_t rowBytes() {
+      return 0;
+    }
+
+    virtual bool isValueNull(int col) = 0;
+
+    virtual void getValue(int col, bool& result) = 0;
 
-    virtual void getValue(const std::string_view name, int& result) = 0;
+    virtual void getValue(int col, int& result) = 0;
 
-    virtual void getValue(const std::string_view name, int64_t& result) = 0;
+    virtual void getValue(int col, int64_t& result) = 0;
 
 #ifdef __SIZEOF_INT128__
-    virtual void getValue(const std::string_view name, __uint128_t& result) = 0;
+    virtual void getValue(int col, __uint128_t& result) = 0;
 #endif
 
-    virtual void getValue(const std::string_view name, double& result) = 0;
+    virtual void getValue(int col, double& result) = 0;
 
-    virtual void getValue(const std::string_view name, std::string& result) = 0;
+    virtual void getValue(int col, std::string& result) = 0;
 
-    virtual void getValue(const std::string_view name, std::vector<uint8_t>& result) = 0;
+    virtual void getValue(int col, std::vector<uint8_t>& result) = 0;
 
-    virtual void getValue(const std::string_view name, orm::date& value) {
+    virtual void getValue(int col, orm::date& value) {
       std::string str;
-      getValue(name, str);
+      getValue(col, str);
       value = str;
     }
 
-    virtual void getValue(const std::string_view name, orm::time& value) {
+    virtual void getValue(int col, orm::time& value) {
       std::string str;
-      getValue(name, str);
+      getValue(col, str);
       value = str;
     }
 
-    virtual void getValue(const std::string_view name, orm::datetime& value) {
+    virtual void getValue(int col, orm::datetime& value) {
       std::string str;
-      getValue(name, str);
+      getValue(col, str);
       value = str;
     }
 
+    bool isValueNull(const std::string_view name) {
+      return isValueNull(columnIndex(name));
+    }
+
+    template <typename T>
+    void getValue(const std::string_view name, T& result) {
+      getValue(columnIndex(name), result);
+    }
+
+    struct binding {
+      int col;
+      orm::field_type type;
+    };
+
+    // decodes the bound columns of the current row in one call, targets[i] points at a value of bindings[i].type.
+    // nulls[i] is set for NULL columns and columns of UNKNOWN type, their targets are left untouched
+    virtual void getValues(const binding* bindings, size_t len, void* const* targets, bool* nulls) {
+      getValues(*this, bindings, len, targets, nulls);
+    }
+
     virtual int columnCount() = 0;
 
     virtual std::string columnName(int i) = 0;
+
+  protected:
+    // backends pass their final type so the per column calls are resolved statically
+    template <typename R>
+    static void getValues(R& resultset, const binding* bindings, size_t len, void* const* targets, bool* nulls) {
+      for (size_t i = 0; i < len; i++) {
+        auto col = bindings[i].col;
+
+        nulls[i] = bindings[i].type == orm::UNKNOWN || resultset.isValueNull(col);
+        if (nulls[i]) {
+          continue;
+        }
+
+        switch (bindings[i].type) {
+        case orm::BOOLEAN:
+          resultset.getValue(col, *static_cast<bool*>(targets[i]));
+          break;
+        case orm::INT32:
+          resultset.getValue(col, *static_cast<int*>(targets[i]));
+          break;
+        case orm::INT64:
+          resultset.getValue(col, *static_cast<int64_t*>(targets[i]));
+          break;
+#ifdef __SIZEOF_INT128__
+        case orm::UINT128:
+          resultset.getValue(col, *static_cast<__uint128_t*>(targets[i]));
+          break;
+#endif
+        case orm::DOUBLE:
+          resultset.getValue(col, *static_cast<double*>(targets[i]));
+          break;
+        case orm::STRING:
+          resultset.getValue(col, *static_cast<std::string*>(targets[i]));
+          break;
+        case orm::BLOB:
+          resultset.getValue(col, *static_cast<std::vector<uint8_t>*>(targets[i]));
+          break;
+        case orm::DATE:
+          resultset.getValue(col, *static_cast<orm::date*>(targets[i]));
+          break;
+        case orm::TIME:
+          resultset.getValue(col, *static_cast<orm::time*>(targets[i]));
+          break;
+        case orm::DATETIME:
+          resultset.getValue(col, *static_cast<orm::datetime*>(targets[i]));
+          break;
+        default:
+          break;
+        }
+      }
+    }
   };
 
   class statement {
@@ -66,36 +148,91 @@ public:
 
     virtual std::shared_ptr<resultset> execute() = 0;
 
+    // like execute, but rows are only fetched as the resultset is stepped. fetch_size is a hint for backends that
+    // can receive several rows at once (postgres with libpq 17 or newer)
+    virtual std::shared_ptr<resultset> executeStream([[maybe_unused]] int fetch_size) {
+      return execute();
+    }
+
     virtual int executeUpdate() = 0;
 
-    virtual void setParamToNull(const std::string_view name) = 0;
+    // returns -1 if there is no such parameter, setting it is a no-op then
+    virtual int parameterIndex(const std::string_view name) = 0;
+
+    virtual void setParamToNull(int index) = 0;
 
-    virtual void setParam(const std::string_view name, bool value) = 0;
+    virtual void setParam(int index, bool value) = 0;
 
-    virtual void setParam(const std::string_view name, int value) = 0;
+    virtual void setParam(int index, int value) = 0;
 
-    virtual void setParam(const std::string_view name, int64_t value) = 0;
+    virtual void setParam(int index, int64_t value) = 0;
 
 #ifdef __SIZEOF_INT128__
-    virtual void setParam(const std::string_view name, __uint128_t value) = 0;
+    virtual void setParam(int index, __uint128_t value) = 0;
 #endif
 
-    virtual void setParam(const std::string_view name, double value) = 0;
+    virtual void setParam(int index, double value) = 0;
+
+    virtual void setParam(int index, const std::string_view value) = 0;
+
+    virtual void setParam(int index, const std::vector<uint8_t>& value) = 0;
+
+    virtual void setParam(int index, orm::date value) {
+      setParam(index, (std::string)value);
+    }
+
+    virtual void setParam(int index, orm::time value) {
+      setParam(index, (std::string)value);
+    }
+
+    virtual void setParam(int index, orm::datetime value) {
+      setParam(index, (std::string)value);
+    }
+
+    void setParamToNull(const std::string_view name) {
+      setParamToNull(parameterIndex(name));
+    }
+
+    void setParam(const std::string_view name, bool value) {
+      setParam(parameterIndex(name), value);
+    }
+
+    void setParam(const std::string_view name, int value) {
+      setParam(parameterIndex(name), value);
+    }
+
+    void setParam(const std::string_view name, int64_t value) {
+      setParam(parameterIndex(name), value);
+    }
+
+#ifdef __SIZEOF_INT128__
+    void setParam(const std::string_view name, __uint128_t value) {
+      setParam(parameterIndex(name), value);
+    }
+#endif
+
+    void setParam(const std::string_view name, double value) {
+      setParam(parameterIndex(name), value);
+    }
 
-    virtual void setParam(const std::string_view name, const std::string_view value) = 0;
+    void setParam(const std::string_view name, const std::string_view value) {
+      setParam(parameterIndex(name), value);
+    }
 
-    virtual void setParam(const std::string_view name, const std::vector<uint8_t>& value) = 0;
+    void setParam(const std::string_view name, const std::vector<uint8_t>& value) {
+      setParam(parameterIndex(name), value);
+    }
 
-    virtual void setParam(const std::string_view name, orm::date value) {
-      setParam(name, (std::string)value);
+    void setParam(const std::string_view name, orm::date value) {
+      setParam(parameterIndex(name), value);
     }
 
-    virtual void setParam(const std::string_view name, orm::time value) {
-      setParam(name, (std::string)value);
+    void setParam(const std::string_view name, orm::time value) {
+      setParam(parameterIndex(name), value);
     }
 
-    virtual void setParam(const std::string_view name, orm::datetime value) {
-      setParam(name, (std::string)value);
+    void setParam(const std::string_view name, orm::datetime value) {
+      setParam(parameterIndex(name), value);
     }
 
     // template <typename T>
@@ -120,6 +257,20 @@ public:
 
     virtual void rollback() = 0;
 
+    // whether a transaction is open on the connection, e.g. one begun by the caller
+    virtual bool inTransaction() {
+      return false;
+    }
+
+    // whether a savepoint costs no more than a function call, i.e. there is no server round trip
+    virtual bool cheapSavepoints() {
+      return false;
+    }
+
+    // lets the current transaction commit without waiting for the disk, if the backend can do so per transaction
+    virtual void relaxCommitDurability() {
+    }
+
     virtual void execute(const std::string_view script) {
       prepareStatement(script)->execute();
     }
@@ -140,6 +291,60 @@ public:
       return {};
     }
 
+    // inserts rows at once, replacing the other fields of existing ids. parameters are named ":field_row".
+    // the INSERT ... ON CONFLICT syntax is shared by sqlite and postgres
+    virtual std::string createUpsertScript(
+        const char* table, const orm::field_info* fields, size_t fields_len, size_t rows) {
+      std::string script = "INSERT INTO \"" + std::string{table} + "\" (";
+
+      for (size_t i = 0; i < fields_len; i++) {
+        if (i > 0) {
+          script += ", ";
+        }
+
+        script += fields[i].name;
+      }
+
+      script += ") VALUES ";
+
+      for (size_t row = 0; row < rows; row++) {
+        script += row > 0 ? ", (" : "(";
+
+        for (size_t i = 0; i < fields_len; i++) {
+          if (i > 0) {
+            script += ", ";
+          }
+
+          script += ":" + std::string{fields[i].name} + "_" + std::to_string(row);
+        }
+
+        script += ")";
+      }
+
+      script += " ON CONFLICT (" + std::string{fields[0].name} + ") DO ";
+
+      if (fields_len == 1) {
+        script += "NOTHING";
+      } else {
+        script += "UPDATE SET ";
+
+        for (size_t i = 1; i < fields_len; i++) {
+          if (i > 1) {
+            script += ", ";
+          }
+
+          script += std::string{fields[i].name} + " = excluded." + fields[i].name;
+        }
+      }
+
+      return script;
+    }
+
+    // the number of parameters a single statement may bind
+    virtual size_t maxParameters() {
+      return 999;
+    }
+
     virtual std::string createUpdateScript(const char* table, const orm::field_info* fields, size_t fields_len) {
       return {};
     }
@@ -155,6 +360,27 @@ public:
     virtual std::string createDeleteScript(const orm::query_builder_data& data) {
       return {};
     }
+
+    // scripts are generated once per connection and key. queries with custom conditions could create
+    // arbitrarily many keys, so the cache starts over when it grows too large
+    template <typename F>
+    const std::string& cachedScript(std::string&& key, F&& create) {
+      auto search = _scripts.find(key);
+      if (search != _scripts.end()) {
+        return search->second;
+      }
+
+      if (_scripts.size() >= max_cached_scripts) {
+        _scripts.clear();
+      }
+
+      return _scripts.emplace(std::move(key), create()).first->second;
+    }
+
+  private:
+    static constexpr size_t max_cached_scripts = 1024;
+
+    std::unordered_map<std::string, std::string> _scripts;
   };
 
   virtual ~datasource() {
@@ -174,27 +400,16 @@ public:
     return _updates;
   }
 
+  // called for every statement prepared or executed through a db::statement of this datasource
+  virtual instrumentation& onQuery() {
+    return _onQuery;
+  }
+
 private:
   std::function<void(db::connection&)> _onConnectionOpen;
   std::function<void(db::connection&)> _onConnectionClose;
+  instrumentation _onQuery;
 
   std::vector<orm::update> _updates;
 };
-
-// class pooled_datasource : public datasource {
-// public:
-//   struct pooled_connection {
-//   public:
-//     std::shared_ptr<datasource::connection> connection;
-//     std::chrono::system_clock::time_point open_since = std::chrono::system_clock::now();
-//     bool in_use = false;
-//   };
-
-//   virtual std::shared_ptr<connection> getPooledConnection() override {
-
-//   }
-
-// private:
-
-// };
 } // namespace db
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "./common.hpp"
+#include "./connection.hpp"
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <vector>
+#ifdef CMAKE_ENABLE_THREADING
+#include <mutex>
+#endif
+
+namespace db::group_commit {
+using clock = std::chrono::steady_clock;
+
+enum class durability {
+  // callers learn about their write once the batch is durably committed
+  SYNC,
+  // the commit may return before it reached the disk where the backend allows it (synchronous_commit = off on
+  // postgres). a crash may lose the latest batches, but never a part of one
+  ASYNC,
+};
+
+struct options {
+  // a batch is committed once it holds max_batch operations or its first one waited max_delay
+  size_t max_batch = 64;
+  clock::duration max_delay = std::chrono::milliseconds(2);
+
+  // ASYNC does nothing on sqlite, its durability is set per connection through the synchronous pragma
+  durability mode = durability::SYNC;
+};
+
+// runs many small writes in one transaction, a failing operation only rolls back itself and the others of its
+// batch still commit. where savepoints are cheap every operation runs in one. otherwise they would cost a round
+// trip each, so a batch first runs without them and, once an operation failed, is rolled back and run once more
+// in savepoints. operations may therefore run twice, must only write through the connection they are given and
+// must not open a db::transaction of their own
+class batcher {
+public:
+  using operation = std::function<void(db::connection&)>;
+  using callback = std::function<void(std::exception_ptr)>;
+
+  struct entry {
+    operation op;
+    callback cb;
+  };
+
+  using batch = std::vector<entry>;
+
+  batcher(db::datasource& dsrc, const options& opts = {}) : _dsrc(dsrc), _options(opts) {
+  }
+
+  batcher(const batcher&) = delete;
+
+  batcher& operator=(const batcher&) = delete;
+
+  // queues op, cb gets its result once its batch has been committed or rolled back.
+  // returns whether the batch is full and should be flushed
+  bool submit(operation op, callback cb) {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+    if (_pending.empty()) {
+      _first_pending = clock::now();
+    }
+
+    _pending.push_back({std::move(op), std::move(cb)});
+
+    return _pending.size() >= _options.max_batch;
+  }
+
+  // commits everything queued so far and calls the callbacks on the calling thread
+  void flush() {
+    auto b = take();
+    if (b.empty()) {
+      return;
+    }
+
+    auto results = execute(b);
+    complete(b, results);
+  }
+
+  bool flushDue() {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+    if (_pending.empty()) {
+      return false;
+    }
+
+    return _pending.size() >= _options.max_batch || clock::now() - _first_pending >= _options.max_delay;
+  }
+
+  size_t pending() {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+    return _pending.size();
+  }
+
+  const options& getOptions() const noexcept {
+    return _options;
+  }
+
+  // flush split into steps, so that a batch can be executed on another thread than the one completing it
+  batch take() {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+    batch b;
+    b.swap(_pending);
+
+    return b;
+  }
+
+  // the error of each operation, operations that did not fail on their own get the error of the commit
+  std::vector<std::exception_ptr> execute(batch& b) {
+    std::vector<std::exception_ptr> results(b.size());
+    if (b.empty()) {
+      return results;
+    }
+
+    try {
+      db::connection conn(_dsrc);
+      execute(conn, b, results);
+    } catch (...) {
+      auto error = std::current_exception();
+
+      for (auto& result : results) {
+        if (!result) {
+          result = error;
+        }
+      }
+    }
+
+    return results;
+  }
+
+  // a throwing callback must not keep the later ones from running, its error is only logged
+  static void complete(batch& b, std::vector<std::exception_ptr>& results) {
+    for (size_t i = 0; i < b.size(); i++) {
+      if (!b[i].cb) {
+        continue;
+      }
+
+      try {
+        b[i].cb(results[i]);
+      } catch (const std::exception& e) {
+        std::cerr << "group commit callback failed: " << e.what() << std::endl;
+      } catch (...) {
+        std::cerr << "group commit callback failed" << std::endl;
+      }
+    }
+  }
+
+private:
+  db::datasource& _dsrc;
+  options _options;
+
+  batch _pending;
+  clock::time_point _first_pending;
+
+#ifdef CMAKE_ENABLE_THREADING
+  std::mutex _mutex;
+#endif
+
+  void execute(db::connection& conn, batch& b, std::vector<std::exception_ptr>& results) {
+    if (!run(conn, b, results, conn.getNativeConnection()->cheapSavepoints())) {
+      run(conn, b, results, true);
+    }
+  }
+
+  // runs the operations that did not fail yet. without savepoints a failing operation rolls back the batch and
+  // false is returned
+  bool run(db::connection& conn, batch& b, std::vector<std::exception_ptr>& results, bool savepoints) {
+    auto native = conn.getNativeConnection();
+
+    native->beginTransaction();
+
+    try {
+      if (_options.mode == durability::ASYNC) {
+        native->relaxCommitDurability();
+      }
+
+      for (size_t i = 0; i < b.size(); i++) {
+        if (results[i]) {
+          continue;
+        }
+
+        if (savepoints) {
+          native->execute("SAVEPOINT db_group_commit");
+        }
+
+        try {
+          b[i].op(conn);
+        } catch (...) {
+          results[i] = std::current_exception();
+
+          if (!savepoints) {
+            native->rollback();
+            return false;
+          }
+
+          native->execute("ROLLBACK TO SAVEPOINT db_group_commit");
+        }
+
+        if (savepoints) {
+          native->execute("RELEASE SAVEPOINT db_group_commit");
+        }
+      }
+
+      native->commit();
+    } catch (...) {
+      try {
+        native->rollback();
+      } catch (...) {
+      }
+
+      throw;
+    }
+
+    return true;
+  }
+};
+} // namespace db::group_commit
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#ifdef CMAKE_ENABLE_THREADING
+#include <mutex>
+#endif
+
+namespace db {
+enum class query_phase {
+  PREPARE,
+  // a statement run through executeUpdate
+  EXECUTE,
+  // a statement run for its rows, reported once its resultset is destroyed and including the time spent in next
+  QUERY,
+  // the time a connection was waited for in a pool
+  POOL_WAIT,
+};
+
+struct query_event {
+  using clock = std::chrono::steady_clock;
+
+  query_phase phase;
+  std::string_view script;
+  clock::duration duration{0};
+  // rows affected by EXECUTE or returned by QUERY
+  int64_t rows = -1;
+  // bytes received for the rows, in-process backends report none
+  uint64_t bytes = 0;
+};
+
+using instrumentation = std::function<void(const query_event&)>;
+
+// aggregates query events into histograms per normalised script, install it with
+// dsrc.onQuery() = stats.hook()
+class query_stats {
+public:
+  using clock = query_event::clock;
+
+  struct histogram {
+    // bucket i counts durations below 2^i microseconds, the last one everything longer
+    static constexpr size_t bucket_count = 32;
+
+    uint64_t buckets[bucket_count] = {};
+    uint64_t count = 0;
+    clock::duration total{0};
+    clock::duration max{0};
+
+    void add(clock::duration duration) {
+      auto micros = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+
+      size_t bucket = 0;
+      while (bucket < bucket_count - 1 && micros >= (uint64_t{1} << bucket)) {
+        bucket += 1;
+      }
+
+      buckets[bucket] += 1;
+      count += 1;
+      total += duration;
+      max = std::max(max, duration);
+    }
+
+    clock::duration average() const noexcept {
+      return count > 0 ? total / (int64_t)count : clock::duration{0};
+    }
+
+    // an upper bound of the fraction p of all durations, p being between 0 and 1
+    clock::duration percentile(double p) const noexcept {
+      uint64_t seen = 0;
+
+      for (size_t bucket = 0; bucket < bucket_count; bucket++) {
+        seen += buckets[bucket];
+
+        if (seen > 0 && seen >= p * count) {
+          return std::min<clock::duration>(std::chrono::microseconds(uint64_t{1} << bucket), max);
+        }
+      }
+
+      return max;
+    }
+  };
+
+  struct entry {
+    histogram prepare;
+    histogram execute;
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+  };
+
+  instrumentation hook() {
+    return [this](const query_event& event) {
+      record(event);
+    };
+  }
+
+  void record(const query_event& event) {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+
+    if (event.phase == query_phase::POOL_WAIT) {
+      _pool_wait.add(event.duration);
+      return;
+    }
+
+    auto& e = _entries[normalised(event.script)];
+
+    if (event.phase == query_phase::PREPARE) {
+      e.prepare.add(event.duration);
+      return;
+    }
+
+    e.execute.add(event.duration);
+    e.rows += std::max<int64_t>(event.rows, 0);
+    e.bytes += event.bytes;
+  }
+
+  std::unordered_map<std::string, entry> entries() {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+    return _entries;
+  }
+
+  // the normalised scripts whose executions took the longest in total
+  std::vector<std::pair<std::string, entry>> slowest(size_t count = 10) {
+    auto all = entries();
+
+    std::vector<std::pair<std::string, entry>> result(all.begin(), all.end());
+    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+      return a.second.execute.total > b.second.execute.total;
+    });
+
+    result.resize(std::min(result.size(), count));
+
+    return result;
+  }
+
+  histogram poolWait() {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+    return _pool_wait;
+  }
+
+  void reset() {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+    _entries.clear();
+    _pool_wait = {};
+  }
+
+  // replaces literals and parameters by ?, collapses lists of them and runs of whitespace, so that queries
+  // differing only in their values, the length of an IN list or the rows of a multi-row VALUES list, whose
+  // parameters are numbered like :name_0, :name_1, share one entry
+  static std::string normalise(const std::string_view script) {
+    std::string result;
+    result.reserve(script.length());
+
+    auto identifier = [](char c) {
+      return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+    };
+
+    auto digit = [](char c) {
+      return c >= '0' && c <= '9';
+    };
+
+    auto placeholder = [&result]() {
+      // "?, ?" becomes "?" and "(?), (?)" becomes "(?)"
+      if (result.ends_with("?, ")) {
+        result.resize(result.length() - 2);
+      } else if (result.ends_with("(?), (")) {
+        result.resize(result.length() - 4);
+      } else {
+        result += '?';
+      }
+    };
+
+    for (size_t i = 0; i < script.length(); i++) {
+      char c = script[i];
+
+      if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        if (!result.empty() && result.back() != ' ') {
+          result += ' ';
+        }
+      } else if (c == '\'') {
+        for (i++; i < script.length(); i++) {
+          if (script[i] == '\'' && (i + 1 >= script.length() || script[i + 1] != '\'')) {
+            break;
+          }
+
+          if (script[i] == '\'') {
+            i++;
+          }
+        }
+
+        placeholder();
+      } else if ((c == ':' || c == '$') && i + 1 < script.length() && digit(script[i + 1]) &&
+                 (i == 0 || script[i - 1] != ':')) {
+        while (i + 1 < script.length() && digit(script[i + 1])) {
+          i++;
+        }
+
+        placeholder();
+      } else if (c == ':' && i + 1 < script.length() && identifier(script[i + 1]) &&
+                 (i == 0 || (!identifier(script[i - 1]) && script[i - 1] != ':'))) {
+        while (i + 1 < script.length() && identifier(script[i + 1])) {
+          i++;
+        }
+
+        placeholder();
+      } else if (digit(c) && (i == 0 || !identifier(script[i - 1]))) {
+        while (i + 1 < script.length() && (digit(script[i + 1]) || script[i + 1] == '.')) {
+          i++;
+        }
+
+        placeholder();
+      } else {
+        result += c;
+      }
+    }
+
+    if (!result.empty() && result.back() == ' ') {
+      result.pop_back();
+    }
+
+    return result;
+  }
+
+private:
+  static constexpr size_t max_cached_scripts = 4096;
+
+  // lets the cache be searched by the string_view of an event, without a copy of the script
+  struct script_hash {
+    using is_transparent = void;
+
+    size_t operator()(const std::string_view script) const noexcept {
+      return std::hash<std::string_view>{}(script);
+    }
+  };
+
+  std::unordered_map<std::string, entry> _entries;
+  std::unordered_map<std::string, std::string, script_hash, std::equal_to<>> _normalised;
+  histogram _pool_wait;
+
+#ifdef CMAKE_ENABLE_THREADING
+  std::mutex _mutex;
+#endif
+
+  const std::string& normalised(const std::string_view script) {
+    auto search = _normalised.find(script);
+    if (search != _normalised.end()) {
+      return search->second;
+    }
+
+    if (_normalised.size() >= max_cached_scripts) {
+      _normalised.clear();
+    }
+
+    auto value = normalise(script);
+    return _normalised.emplace(script, std::move(value)).first->second;
+  }
+};
+} // namespace db
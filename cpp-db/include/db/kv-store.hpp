@@ -1,27 +1,350 @@
 #pragma once
 
 #include "./connection.hpp"
+#include "./resultset.hpp"
 #include "./statement.hpp"
+#include "./transaction.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef CMAKE_ENABLE_THREADING
+#include <mutex>
+#endif
 
 namespace db::kv {
+using clock = std::chrono::steady_clock;
+
+struct options {
+  // values kept in memory, keys known to be missing count as well
+  size_t cache_capacity = 4096;
+
+  // writes are buffered and coalesced per key until flush_threshold keys are pending
+  // or the oldest pending write is flush_interval old
+  size_t flush_threshold = 256;
+  clock::duration flush_interval = std::chrono::milliseconds(100);
+
+  // whether set and erase flush a due buffer themselves, otherwise the owner calls flush
+  bool flush_on_write = true;
+
+  // keys looked up by a single query of multiGet
+  size_t max_keys_per_query = 256;
+};
+
+// string values by string key in the db_kv_store table, with an LRU read cache and a write-behind buffer.
+// reads see buffered writes immediately, the database only once they are flushed
 class store {
 public:
-  store(db::datasource& dsrc) : _conn(dsrc), _stmt_select(_conn), _stmt_upsert(_conn) {
+  store(db::datasource& dsrc, const options& opts = {})
+      : _options(opts), _conn(dsrc), _stmt_select(_conn), _stmt_upsert(_conn), _stmt_delete(_conn) {
     _conn.execute("CREATE TABLE IF NOT EXISTS db_kv_store (key TEXT PRIMARY KEY, value TEXT)");
 
     _stmt_select.prepare("SELECT value FROM db_kv_store WHERE key = :key");
-    _stmt_upsert.prepare("INSERT INTO db_kv_store VALUES (:key, :value) ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value");
+    _stmt_upsert.prepare(
+        "INSERT INTO db_kv_store VALUES (:key, :value) ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value");
+    _stmt_delete.prepare("DELETE FROM db_kv_store WHERE key = :key");
   }
 
-  db::statement::parameter& operator[](const std::string_view key) {
+  store(const store&) = delete;
+
+  store& operator=(const store&) = delete;
+
+  // buffered writes are lost if this last flush fails
+  virtual ~store() noexcept {
+    try {
+      flush();
+    } catch (...) {
+    }
+  }
+
+  std::optional<std::string> get(const std::string_view key) {
+    if (auto hit = cached(key)) {
+      return *hit;
+    }
+
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock conn_lock(_conn_mutex);
+#endif
+
     _stmt_select.params[":key"] = key;
-    _stmt_upsert.params[":key"] = key;
+
+    std::optional<std::string> value;
+
+    db::resultset resultset{_stmt_select};
+    if (resultset.next()) {
+      resultset.get(0, value);
+    }
+
+    return remember(key, std::move(value));
+  }
+
+  // values in the order of keys, all keys missing from the cache are looked up together
+  template <typename R>
+  std::vector<std::optional<std::string>> multiGet(const R& keys) {
+    std::vector<std::string> names(std::begin(keys), std::end(keys));
+    std::vector<std::optional<std::string>> result(names.size());
+    std::vector<size_t> misses;
+
+    for (size_t i = 0; i < names.size(); i++) {
+      if (auto hit = cached(names[i])) {
+        result[i] = std::move(*hit);
+      } else {
+        misses.push_back(i);
+      }
+    }
+
+    if (misses.empty()) {
+      return result;
+    }
+
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock conn_lock(_conn_mutex);
+#endif
+
+    auto native = _conn.getNativeConnection();
+    size_t chunk_size = std::max<size_t>(_options.max_keys_per_query, 1);
+
+    std::unordered_map<std::string, std::string> found;
+
+    for (size_t offset = 0; offset < misses.size(); offset += chunk_size) {
+      size_t count = std::min(misses.size() - offset, chunk_size);
+
+      // padded with the last key to a power of two so that only a few statement shapes get prepared
+      size_t padded = 1;
+      while (padded < count) {
+        padded *= 2;
+      }
+
+      db::statement statement(_conn);
+      statement.prepare(native->cachedScript("kv select " + std::to_string(padded), [padded]() {
+        std::string script = "SELECT key, value FROM db_kv_store WHERE key IN (";
+
+        for (size_t i = 0; i < padded; i++) {
+          script += (i > 0 ? ", :" : ":") + std::to_string(i);
+        }
+
+        return script + ")";
+      }));
+
+      for (size_t i = 0; i < padded; i++) {
+        statement.params[i] = names[misses[offset + std::min(i, count - 1)]];
+      }
+
+      db::resultset resultset{statement};
+      while (resultset.next()) {
+        std::string key;
+        std::optional<std::string> value;
+        resultset.get(0, key);
+        resultset.get(1, value);
+
+        if (value) {
+          found[std::move(key)] = std::move(*value);
+        }
+      }
+    }
+
+    for (auto index : misses) {
+      std::optional<std::string> value;
+
+      auto search = found.find(names[index]);
+      if (search != found.end()) {
+        value = search->second;
+      }
+
+      result[index] = remember(names[index], std::move(value));
+    }
+
+    return result;
+  }
+
+  void set(const std::string_view key, std::string value) {
+    write(key, std::move(value));
+  }
+
+  void erase(const std::string_view key) {
+    write(key, std::nullopt);
+  }
+
+  // writes all buffered keys in one transaction, a failed batch is buffered again behind newer writes
+  void flush() {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock conn_lock(_conn_mutex);
+#endif
+
+    std::unordered_map<std::string, std::optional<std::string>> batch;
+    {
+#ifdef CMAKE_ENABLE_THREADING
+      std::unique_lock lock(_mutex);
+#endif
+      batch.swap(_pending);
+    }
+
+    if (batch.empty()) {
+      return;
+    }
+
+    try {
+      db::transaction transaction(_conn);
+
+      for (const auto& [key, value] : batch) {
+        if (value) {
+          _stmt_upsert.params[":key"] = key;
+          _stmt_upsert.params[":value"] = *value;
+          _stmt_upsert.executeUpdate();
+        } else {
+          _stmt_delete.params[":key"] = key;
+          _stmt_delete.executeUpdate();
+        }
+      }
+
+      transaction.commit();
+    } catch (...) {
+#ifdef CMAKE_ENABLE_THREADING
+      std::unique_lock lock(_mutex);
+#endif
+      if (_pending.empty()) {
+        _first_pending = clock::now();
+      }
+
+      for (auto& entry : batch) {
+        _pending.insert(std::move(entry));
+      }
+
+      throw;
+    }
+  }
+
+  bool flushDue() {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+    return isFlushDue();
+  }
+
+  size_t pending() {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+    return _pending.size();
+  }
+
+  // the value of key if it is known without asking the database, an empty optional inside means missing
+  std::optional<std::optional<std::string>> cached(const std::string_view key) {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+    return lookup(key);
+  }
+
+  const options& getOptions() const noexcept {
+    return _options;
   }
 
 private:
-  db::connection _conn;
+  using lru_list = std::list<std::pair<std::string, std::optional<std::string>>>;
 
+  options _options;
+
+  db::connection _conn;
   db::statement _stmt_select;
   db::statement _stmt_upsert;
+  db::statement _stmt_delete;
+
+  lru_list _lru;
+  std::unordered_map<std::string_view, lru_list::iterator> _index;
+
+  std::unordered_map<std::string, std::optional<std::string>> _pending;
+  clock::time_point _first_pending;
+
+#ifdef CMAKE_ENABLE_THREADING
+  // _mutex guards the cache and the buffer, _conn_mutex the connection. the database is never
+  // accessed while holding _mutex, so cache hits do not wait for queries or flushes
+  std::mutex _mutex;
+  std::mutex _conn_mutex;
+#endif
+
+  void write(const std::string_view key, std::optional<std::string>&& value) {
+    bool due;
+    {
+#ifdef CMAKE_ENABLE_THREADING
+      std::unique_lock lock(_mutex);
+#endif
+      if (_pending.empty()) {
+        _first_pending = clock::now();
+      }
+
+      _pending.insert_or_assign(std::string{key}, value);
+      put(key, std::move(value));
+
+      due = _options.flush_on_write && isFlushDue();
+    }
+
+    if (due) {
+      flush();
+    }
+  }
+
+  bool isFlushDue() const {
+    if (_pending.empty()) {
+      return false;
+    }
+
+    return _pending.size() >= _options.flush_threshold || clock::now() - _first_pending >= _options.flush_interval;
+  }
+
+  std::optional<std::optional<std::string>> lookup(const std::string_view key) {
+    auto pending = _pending.find(std::string{key});
+    if (pending != _pending.end()) {
+      return pending->second;
+    }
+
+    auto search = _index.find(key);
+    if (search == _index.end()) {
+      return {};
+    }
+
+    _lru.splice(_lru.begin(), _lru, search->second);
+
+    return search->second->second;
+  }
+
+  // caches a value read from the database unless a newer one was written meanwhile
+  std::optional<std::string> remember(const std::string_view key, std::optional<std::string>&& value) {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+    if (auto known = lookup(key)) {
+      return *known;
+    }
+
+    put(key, std::optional<std::string>{value});
+
+    return value;
+  }
+
+  void put(const std::string_view key, std::optional<std::string>&& value) {
+    auto search = _index.find(key);
+    if (search != _index.end()) {
+      search->second->second = std::move(value);
+      _lru.splice(_lru.begin(), _lru, search->second);
+      return;
+    }
+
+    if (_options.cache_capacity == 0) {
+      return;
+    }
+
+    _lru.emplace_front(std::string{key}, std::move(value));
+    _index[_lru.front().first] = _lru.begin();
+
+    if (_lru.size() > _options.cache_capacity) {
+      _index.erase(_lru.back().first);
+      _lru.pop_back();
+    }
+  }
 };
-} // namespace db::pooled
+} // namespace db::kv
@@ -167,6 +167,9 @@ struct condition_container {
     int i = 666;
     assignToParams(statement, i);
   }
+
+  // describes the structure and fields of the condition, conditions with the same key produce the same sql
+  virtual void appendToKey(std::string& key) const = 0;
 };
 
 struct query_builder_data {
@@ -182,6 +185,45 @@ struct query_builder_data {
   std::vector<std::shared_ptr<condition_container>> conditions;
   std::vector<order_by_clause> ordering;
   int limit = 0;
+
+  // identifies the generated script, queries of the same shape share it
+  std::string key(const char* kind) const {
+    std::string key{kind};
+
+    key += ' ';
+    key += table;
+    key += '|';
+
+    for (const auto& field : fields) {
+      key += field;
+      key += ',';
+    }
+
+    key += '|';
+
+    for (const auto& assignment : assignments) {
+      assignment->appendToKey(key);
+    }
+
+    key += '|';
+
+    for (const auto& condition : conditions) {
+      condition->appendToKey(key);
+    }
+
+    key += '|';
+
+    for (const auto& clause : ordering) {
+      key += clause.field;
+      key += (char)('0' + clause.direction);
+      key += (char)('0' + clause.nulls);
+    }
+
+    key += '|';
+    key += std::to_string(limit);
+
+    return key;
+  }
 };
 
 template <typename T>
@@ -2,6 +2,13 @@
 
 #include "./connection.hpp"
 #include "./orm.hpp"
+#include "./transaction.hpp"
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
 
 namespace db::orm {
 class repository {
@@ -29,6 +36,51 @@ public:
     return findOneById<T>(*id);
   }
 
+  // looks up the objects of all ids in as few queries as possible, in no particular order. lists are padded
+  // with their last id to a power of two so that only a few statement shapes get prepared
+  template <typename T, typename R>
+  std::vector<T> findAllByIds(const R& ids, size_t max_ids = 1024) {
+    using meta = db::orm::meta<T>;
+    using id_type = typename meta::id_type;
+
+    constexpr auto id_field = db::orm::field<id_type>{meta::class_members[0].name};
+
+    auto max_parameters = _conn.getNativeConnection()->maxParameters();
+    size_t chunk_size = std::clamp<size_t>(max_parameters, 1, std::max<size_t>(max_ids, 1));
+
+    std::vector<T> result;
+    std::vector<id_type> chunk;
+
+    auto flush = [&]() {
+      size_t padded = 1;
+      while (padded < chunk.size()) {
+        padded *= 2;
+      }
+
+      chunk.resize(std::min(padded, chunk_size), chunk.back());
+
+      for (auto& value : db::orm::selector<T>{_conn}.select().where(id_field.in(chunk)).findAll()) {
+        result.push_back(std::move(value));
+      }
+
+      chunk.clear();
+    };
+
+    for (const auto& id : ids) {
+      chunk.push_back(id);
+
+      if (chunk.size() == chunk_size) {
+        flush();
+      }
+    }
+
+    if (!chunk.empty()) {
+      flush();
+    }
+
+    return result;
+  }
+
   template <typename T>
   int save(T& source) {
     using meta = db::orm::meta<T>;
@@ -37,27 +89,130 @@ public:
     auto fields = (const db::orm::field_info*)&meta::class_members;
     auto fields_len = sizeof(meta::class_members) / sizeof(db::orm::field_info);
 
-    if (!_conn.getNativeConnection()->supportsORM()) {
+    auto native = _conn.getNativeConnection();
+    if (!native->supportsORM()) {
       throw db::sql_error{"unsupported"};
     }
 
-    std::string script;
+    db::statement statement(_conn);
 
     if (id::isNull(meta::getId(source))) {
       meta::setId(source, id::generate());
 
-      script = _conn.getNativeConnection()->createInsertScript(meta::class_name, fields, fields_len);
+      static const std::string key = scriptKey<T>("insert");
+
+      statement.prepare(native->cachedScript(std::string{key}, [&]() {
+        return native->createInsertScript(meta::class_name, fields, fields_len);
+      }));
     } else {
-      script = _conn.getNativeConnection()->createUpdateScript(meta::class_name, fields, fields_len);
+      static const std::string key = scriptKey<T>("update");
+
+      statement.prepare(native->cachedScript(std::string{key}, [&]() {
+        return native->createUpdateScript(meta::class_name, fields, fields_len);
+      }));
     }
 
-    db::statement statement(_conn);
-    statement.prepare(script);
     meta::serialize(statement, source);
 
     return statement.executeUpdate();
   }
 
+  // inserts or updates all objects in multi-row statements of up to max_rows objects or as many as the backend's
+  // parameter limit allows. objects without an id get one generated like in save. it runs in the caller's
+  // transaction if one is open, otherwise in one of its own. an id that occurs twice starts a new statement, so
+  // that like with save the last object wins, postgres refuses to update a row twice in one statement
+  template <typename R>
+  int saveAll(R& sources, size_t max_rows = 1000) {
+    using T = std::remove_cvref_t<decltype(*std::begin(sources))>;
+    using meta = db::orm::meta<T>;
+    using id = db::orm::id<typename meta::id_type>;
+
+    constexpr size_t fields_len = std::size(meta::class_members);
+
+    auto native = _conn.getNativeConnection();
+    if (!native->supportsORM()) {
+      throw db::sql_error{"unsupported"};
+    }
+
+    size_t batch_size = std::clamp<size_t>(native->maxParameters() / fields_len, 1, std::max<size_t>(max_rows, 1));
+
+    std::optional<db::transaction> transaction;
+    if (!native->inTransaction()) {
+      transaction.emplace(_conn);
+    }
+
+    db::statement statement(_conn);
+
+    std::vector<T*> batch;
+    std::set<typename meta::id_type> batch_ids;
+    std::vector<int> indices;
+    size_t prepared_rows = 0;
+    int result = 0;
+
+    // full batches share one prepared statement, only the last one needs its own
+    auto flush = [&]() {
+      if (prepared_rows != batch.size()) {
+        prepared_rows = batch.size();
+        static const std::string upsert_key = scriptKey<T>("upsert");
+        auto key = upsert_key + std::to_string(prepared_rows);
+        statement.prepare(native->cachedScript(std::move(key), [&]() {
+          return native->createUpsertScript(meta::class_name, meta::class_members, fields_len, prepared_rows);
+        }));
+
+        auto index = [&](size_t row, size_t i) {
+          return statement.parameterIndex(std::string{":"} + meta::class_members[i].name + "_" + std::to_string(row));
+        };
+
+        // backends number the parameters in order of appearance, row by row. looking each of them up by name
+        // is linear in the number of parameters on sqlite, so only the first row is, unless the last disagrees
+        indices.resize(prepared_rows * fields_len);
+        for (size_t i = 0; i < fields_len; i++) {
+          indices[i] = index(0, i);
+        }
+
+        size_t last = (prepared_rows - 1) * fields_len;
+        bool strided = index(prepared_rows - 1, 0) == indices[0] + (int)last;
+
+        for (size_t row = 1; row < prepared_rows; row++) {
+          for (size_t i = 0; i < fields_len; i++) {
+            indices[row * fields_len + i] = strided ? indices[i] + (int)(row * fields_len) : index(row, i);
+          }
+        }
+      }
+
+      for (size_t row = 0; row < batch.size(); row++) {
+        meta::serialize(statement, *batch[row], indices.data() + row * fields_len);
+      }
+
+      result += statement.executeUpdate();
+      batch.clear();
+      batch_ids.clear();
+    };
+
+    for (auto& source : sources) {
+      if (id::isNull(meta::getId(source))) {
+        meta::setId(source, id::generate());
+      }
+
+      if (!batch_ids.insert(meta::getId(source)).second) {
+        flush();
+        batch_ids.insert(meta::getId(source));
+      }
+
+      batch.push_back(&source);
+
+      if (batch.size() == batch_size) {
+        flush();
+      }
+    }
+
+    if (!batch.empty()) {
+      flush();
+    }
+
+    return result;
+  }
+
   template <typename T>
   int save(std::optional<T>& source) {
     if (source) {
@@ -105,5 +260,22 @@ public:
 
 private:
   db::connection& _conn;
+
+  // the members belong to the key, types mapped to the same table may differ in them
+  template <typename T>
+  static std::string scriptKey(const char* kind) {
+    std::string key{kind};
+
+    key += ' ';
+    key += db::orm::meta<T>::class_name;
+    key += '|';
+
+    for (const auto& field : db::orm::meta<T>::class_members) {
+      key += field.name;
+      key += ',';
+    }
+
+    return key;
+  }
 };
 } // namespace db::orm
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "./resultset.hpp"
+#include <iterator>
+#include <memory>
 #include <ostream>
 #include <string>
 
@@ -143,6 +145,9 @@ std::ostream& operator<<(std::ostream& os, condition_operator op) {
   case condition_operator::IS_NOT_NULL:
     os << " IS NOT NULL";
     break;
+  case condition_operator::IN:
+    os << " IN ";
+    break;
   }
 
   return os;
@@ -209,6 +214,15 @@ struct condition : public condition_container {
     } else {
       if constexpr (std::is_same<R, std::nullopt_t>::value) {
       } else if constexpr (O == condition_operator::CUSTOM) {
+      } else if constexpr (O == condition_operator::IN) {
+        // an empty list matches nothing
+        os << (right.empty() ? "(NULL" : "(");
+
+        for (size_t k = 0; k < right.size(); k++) {
+          os << (k > 0 ? ", :" : ":") << i++;
+        }
+
+        os << ")";
       } else {
         os << ":" << i++;
       }
@@ -234,11 +248,51 @@ struct condition : public condition_container {
       if constexpr (std::is_same<R, std::nullopt_t>::value) {
       } else if constexpr (O == condition_operator::CUSTOM) {
         statement.params[right.name] = right.value;
+      } else if constexpr (O == condition_operator::IN) {
+        if (right.empty()) {
+          return;
+        }
+
+        // the list is numbered in order of appearance, looking up each name is linear on sqlite. only the
+        // first and last are looked up, unless they disagree
+        auto index = [&](size_t k) {
+          return statement.parameterIndex(std::string{":"} + std::to_string(i + (int)k));
+        };
+
+        int first = index(0);
+        bool strided = index(right.size() - 1) == first + (int)right.size() - 1;
+
+        size_t k = 0;
+        for (const auto& value : right) {
+          statement.params[strided ? first + (int)k : index(k)] = value;
+          k++;
+        }
+
+        i += (int)right.size();
       } else {
         statement.params[std::string{":"} + std::to_string(i++)] = right;
       }
     }
   }
+
+  void appendToKey(std::string& key) const override {
+    key += '(';
+    key += (char)('A' + (int)O);
+
+    if constexpr (O != condition_operator::CUSTOM) {
+      left.appendToKey(key);
+    } else {
+      key += left;
+    }
+
+    if constexpr (is_condition_or_field<R>::value) {
+      right.appendToKey(key);
+    } else if constexpr (O == condition_operator::IN) {
+      key += std::to_string(right.size());
+    }
+
+    key += ')';
+  }
 };
 
 template <typename T>
@@ -281,14 +335,21 @@ struct field {
     return {*this, right};
   }
 
-  // constexpr condition<field, condition_operator::IN, T> IN(const std::vector<T>& right) const {
-  //   return {*this, right};
-  // }
+  // matches any value of the range, each one is bound as its own parameter
+  template <typename R>
+  condition<field, condition_operator::IN, std::vector<T>> in(const R& range) const {
+    return {*this, std::vector<T>(std::begin(range), std::end(range))};
+  }
 
   void appendToQuery(std::ostream& os, int&) const {
     os << name;
   }
 
+  void appendToKey(std::string& key) const {
+    key += name;
+    key += ',';
+  }
+
   operator const char*() {
     return name;
   }
@@ -321,6 +382,154 @@ struct fields {
   static constexpr bool specialized = false;
 };
 
+// decodes rows into T through a column map bound once, each row costs one virtual call into the backend.
+// fields of custom types fall back to resultset::get
+template <typename T>
+class row_reader {
+public:
+  using meta = db::orm::meta<T>;
+
+  static constexpr size_t fields_len = std::size(meta::class_members);
+
+  explicit row_reader(db::resultset& resultset)
+      : _resultset(resultset), _native_resultset(resultset.getNativeResultset()) {
+    const auto& indices = resultset.columnIndices(meta::class_members, fields_len);
+
+    for (size_t i = 0; i < fields_len; i++) {
+      _bindings[i] = {indices[i], meta::class_members[i].type};
+    }
+  }
+
+  void read(T& result) {
+    size_t i = 0;
+    meta::forEachField(result, [this, &i](auto& field) {
+      bind(i++, field);
+    });
+
+    _native_resultset->getValues(_bindings, fields_len, _targets, _nulls);
+
+    i = 0;
+    meta::forEachField(result, [this, &i](auto& field) {
+      assign(i++, field);
+    });
+  }
+
+private:
+  db::resultset& _resultset;
+  std::shared_ptr<db::datasource::resultset> _native_resultset;
+
+  db::datasource::resultset::binding _bindings[fields_len];
+  void* _targets[fields_len];
+  bool _nulls[fields_len];
+
+  template <typename F>
+  void bind(size_t i, F& field) {
+    using converter = field_type_converter<F>;
+
+    if constexpr (converter::type == UNKNOWN) {
+      _targets[i] = nullptr;
+    } else if constexpr (converter::optional) {
+      _targets[i] = &field.emplace();
+    } else {
+      _targets[i] = &field;
+    }
+  }
+
+  template <typename F>
+  void assign(size_t i, F& field) {
+    using converter = field_type_converter<F>;
+
+    if constexpr (converter::type == UNKNOWN) {
+      if constexpr (converter::optional) {
+        field.reset();
+      }
+
+      _resultset.get(_bindings[i].col, field);
+    } else if constexpr (converter::optional) {
+      if (_nulls[i]) {
+        field.reset();
+      }
+    }
+  }
+};
+
+// rows of a query decoded one at a time while iterating, the objects are not kept
+template <typename T>
+class row_stream {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T*;
+    using reference = T&;
+
+    explicit iterator(row_stream* stream) : _stream(stream) {
+      if (_stream && !_stream->advance()) {
+        _stream = nullptr;
+      }
+    }
+
+    iterator& operator++() {
+      if (!_stream->advance()) {
+        _stream = nullptr;
+      }
+
+      return *this;
+    }
+
+    bool operator==(const iterator& other) const {
+      return _stream == other._stream;
+    }
+
+    bool operator!=(const iterator& other) const {
+      return !(*this == other);
+    }
+
+    T& operator*() const {
+      return _stream->_current;
+    }
+
+    T* operator->() const {
+      return &_stream->_current;
+    }
+
+  private:
+    row_stream* _stream;
+  };
+
+  row_stream(std::unique_ptr<db::statement> statement, int fetch_size)
+      : _statement(std::move(statement)), _resultset(std::make_unique<db::resultset>(*_statement, fetch_size)),
+        _reader(std::make_unique<row_reader<T>>(*_resultset)) {
+  }
+
+  iterator begin() {
+    return iterator(this);
+  }
+
+  iterator end() {
+    return iterator(nullptr);
+  }
+
+private:
+  std::unique_ptr<db::statement> _statement;
+  std::unique_ptr<db::resultset> _resultset;
+  std::unique_ptr<row_reader<T>> _reader;
+  T _current;
+
+  bool advance() {
+    if (!_resultset->next()) {
+      return false;
+    }
+
+    _current = T{};
+    _reader->read(_current);
+
+    return true;
+  }
+};
+
 template <typename T>
 class selector {
 public:
@@ -380,8 +589,10 @@ public:
 
     _data.table = meta::class_name;
 
-    std::string script = _connection._datasource_connection->createSelectScript(_data);
-    statement.prepare(script);
+    auto& native = *_connection._datasource_connection;
+    statement.prepare(native.cachedScript(_data.key("select"), [this, &native]() {
+      return native.createSelectScript(_data);
+    }));
 
     for (auto condition : _data.conditions) {
       condition->assignToParams(statement);
@@ -389,32 +600,50 @@ public:
   }
 
   std::vector<T> findAll() {
-    using meta = db::orm::meta<T>;
-
     db::statement statement(_connection);
     prepare(statement);
 
     std::vector<T> result;
 
-    for (db::resultset& resultset : db::resultset{statement}) {
+    db::resultset resultset{statement};
+    db::orm::row_reader<T> reader{resultset};
+
+    while (resultset.next()) {
       T value;
-      meta::deserialize(resultset, value);
+      reader.read(value);
       result.push_back(std::move(value));
     }
 
     return result;
   }
 
+  // runs the query lazily, large results are read in constant memory. fetch_size rows are received at once
+  // where the backend supports it (postgres with libpq 17 or newer), otherwise one at a time
+  row_stream<T> stream(int fetch_size = 1) {
+    auto statement = std::make_unique<db::statement>(_connection);
+    prepare(*statement);
+
+    return row_stream<T>{std::move(statement), fetch_size};
+  }
+
+  // a plain query, there is nothing to stream with LIMIT 1
   std::optional<T> findOne() {
     _data.limit = 1;
 
-    auto list = findAll();
+    db::statement statement(_connection);
+    prepare(statement);
+
+    db::resultset resultset{statement};
+    db::orm::row_reader<T> reader{resultset};
 
-    if (list.empty()) {
+    if (!resultset.next()) {
       return {};
     }
 
-    return {std::move(list.at(0))};
+    T value;
+    reader.read(value);
+
+    return {std::move(value)};
   }
 
 private:
@@ -458,8 +687,10 @@ public:
 
     _data.table = meta::class_name;
 
-    std::string script = _connection._datasource_connection->createDeleteScript(_data);
-    statement.prepare(script);
+    auto& native = *_connection._datasource_connection;
+    statement.prepare(native.cachedScript(_data.key("delete"), [this, &native]() {
+      return native.createDeleteScript(_data);
+    }));
 
     for (auto condition : _data.conditions) {
       condition->assignToParams(statement);
@@ -513,8 +744,10 @@ public:
 
     _data.table = meta::class_name;
 
-    std::string script = _connection._datasource_connection->createUpdateScript(_data);
-    statement.prepare(script);
+    auto& native = *_connection._datasource_connection;
+    statement.prepare(native.cachedScript(_data.key("update"), [this, &native]() {
+      return native.createUpdateScript(_data);
+    }));
 
     int param = 666;
 
@@ -606,9 +839,9 @@ struct query {
   {#FIELD, db::orm::field_type_converter<decltype(class_type::FIELD)>::type, \
       db::orm::field_type_converter<decltype(class_type::FIELD)>::optional},
 
-#define DB_ORM_SERIALIZER_STATEMENT_SET(FIELD) statement.params[":" #FIELD] = source.FIELD;
+#define DB_ORM_SERIALIZER_STATEMENT_SET(FIELD) statement.params[indices[i++]] = source.FIELD;
 
-#define DB_ORM_DESERIALIZER_RESULTSET_GET(FIELD) resultset.get(#FIELD, result.FIELD);
+#define DB_ORM_VISITOR_FIELD(FIELD) f(target.FIELD);
 
 #define DB_ORM_FIELD_INIT(FIELD) static constexpr db::orm::field<decltype(class_type::FIELD)> FIELD{#FIELD};
 
@@ -632,11 +865,22 @@ struct query {
     }                                                                                                       \
                                                                                                             \
     static void serialize(db::statement& statement, const TYPE& source) {                                   \
+      const auto& indices = statement.parameterIndices(class_members, std::size(class_members));            \
+      serialize(statement, source, indices.data());                                                         \
+    }                                                                                                       \
+                                                                                                            \
+    static void serialize(db::statement& statement, const TYPE& source, const int* indices) {               \
+      size_t i = 0;                                                                                         \
       FOR_EACH(DB_ORM_SERIALIZER_STATEMENT_SET, FIELDS)                                                     \
     }                                                                                                       \
                                                                                                             \
     static void deserialize(db::resultset& resultset, TYPE& result) {                                       \
-      FOR_EACH(DB_ORM_DESERIALIZER_RESULTSET_GET, FIELDS)                                                   \
+      db::orm::row_reader<TYPE>{resultset}.read(result);                                                    \
+    }                                                                                                       \
+                                                                                                            \
+    template <typename F>                                                                                   \
+    static void forEachField(TYPE& target, F&& f) {                                                         \
+      FOR_EACH(DB_ORM_VISITOR_FIELD, FIELDS)                                                                \
     }                                                                                                       \
   };                                                                                                        \
                                                                                                             \
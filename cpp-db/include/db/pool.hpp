@@ -1,36 +1,531 @@
 #pragma once
 
+#include "./common.hpp"
 #include "./connection.hpp"
-#include <shared_mutex>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#ifdef CMAKE_ENABLE_THREADING
+#include <condition_variable>
+#include <mutex>
+#endif
 
 namespace db::pooled {
-class datasource : public db::datasource {
+using clock = std::chrono::steady_clock;
+
+struct options {
+  size_t min_size = 0;
+  size_t max_size = 16;
+
+  // how long getConnection blocks for a free connection, only used with CMAKE_ENABLE_THREADING
+  clock::duration acquire_timeout = std::chrono::seconds(30);
+
+  // idle connections above min_size are closed after idle_timeout, all connections after max_lifetime.
+  // a zero duration disables the limit
+  clock::duration idle_timeout = std::chrono::minutes(10);
+  clock::duration max_lifetime = std::chrono::minutes(30);
+
+  // connections idle for longer than validation_interval run validation_query before they are handed out
+  clock::duration validation_interval = std::chrono::seconds(30);
+  std::string validation_query = "SELECT 1";
+};
+
+struct metrics {
+  size_t max_size = 0;
+  size_t size = 0;
+  size_t idle = 0;
+  size_t waiting = 0;
+
+  uint64_t acquired = 0;
+  uint64_t created = 0;
+  uint64_t closed = 0;
+  uint64_t timeouts = 0;
+  uint64_t failed_validations = 0;
+
+  clock::duration total_wait{0};
+  clock::duration max_wait{0};
+
+  size_t inUse() const noexcept {
+    return size - idle;
+  }
+
+  double utilisation() const noexcept {
+    return max_size > 0 ? (double)inUse() / max_size : 0;
+  }
+
+  clock::duration averageWait() const noexcept {
+    return acquired > 0 ? total_wait / (int64_t)acquired : clock::duration{0};
+  }
+};
+
+// connections are handed out as shared_ptrs whose deleter returns them to the pool.
+// waiters are served in FIFO order, a returned connection goes straight to the oldest one
+class pool : public std::enable_shared_from_this<pool> {
 public:
-  datasource(db::datasource& dsrc) : _dsrc(dsrc) {
+  using callback = std::function<void(std::shared_ptr<db::datasource::connection>, std::exception_ptr)>;
+
+  pool(db::datasource& dsrc, const options& opts) : _dsrc(dsrc), _options(opts) {
+    if (_options.max_size == 0) {
+      _options.max_size = 1;
+    }
+
+    _options.min_size = std::min(_options.min_size, _options.max_size);
   }
 
-  std::shared_ptr<db::datasource::connection> getConnection() override {
+  pool(const pool&) = delete;
+
+  pool& operator=(const pool&) = delete;
+
+  std::shared_ptr<db::datasource::connection> acquire() {
+    auto since = clock::now();
+
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+
+    assertOpen();
+
+    std::optional<entry> e = take();
+
+    if (!e) {
+#ifdef CMAKE_ENABLE_THREADING
+      auto w = std::make_shared<waiter>();
+      _waiters.push_back(w);
+
+      if (!w->cv.wait_until(lock, since + _options.acquire_timeout, [this, &w]() {
+            return w->handed || _closed;
+          })) {
+        _waiters.erase(std::find(_waiters.begin(), _waiters.end(), w));
+        _metrics.timeouts += 1;
+
+        throw sql_error("timed out waiting for a pooled connection");
+      }
+
+      assertOpen();
+      e = std::move(w->handed);
+#else
+      throw sql_error("connection pool exhausted");
+#endif
+    }
+
+    recordWait(since);
+
+#ifdef CMAKE_ENABLE_THREADING
+    lock.unlock();
+#endif
+
+    return checkout(std::move(*e), since);
+  }
+
+  // calls cb once a connection is available instead of blocking, for use on an event loop
+  void acquire(callback cb) {
+    auto since = clock::now();
+    auto w = std::make_shared<waiter>();
+
+    try {
+#ifdef CMAKE_ENABLE_THREADING
+      std::unique_lock lock(_mutex);
+#endif
+
+      assertOpen();
+
+      if (!(w->handed = take())) {
+        // the waiter is kept alive by whoever resumes it
+        w->resume = [this, w = w.get(), since, cb](std::exception_ptr error) {
+          if (!error) {
+            {
+#ifdef CMAKE_ENABLE_THREADING
+              std::unique_lock lock(_mutex);
+#endif
+
+              recordWait(since);
+            }
+
+            checkout(std::move(*w->handed), since, cb);
+          } else {
+            cb(nullptr, error);
+          }
+        };
+
+        _waiters.push_back(w);
+        return;
+      }
+
+      recordWait(since);
+    } catch (...) {
+      cb(nullptr, std::current_exception());
+      return;
+    }
+
+    checkout(std::move(*w->handed), since, cb);
+  }
+
+  // opens connections up to min_size
+  void prefill() {
+    while (true) {
+      {
+#ifdef CMAKE_ENABLE_THREADING
+        std::unique_lock lock(_mutex);
+#endif
+
+        if (_closed || _size >= _options.min_size) {
+          return;
+        }
+
+        _size += 1;
+      }
+
+      entry e;
+      try {
+        e = open();
+      } catch (...) {
+        discard();
+        throw;
+      }
+
+      release(std::move(e));
+    }
+  }
+
+  // closes idle connections past their idle timeout or lifetime, acquire and release do this as well
+  void evict() {
+    std::list<entry> expired;
+    {
+#ifdef CMAKE_ENABLE_THREADING
+      std::unique_lock lock(_mutex);
+#endif
+
+      expired = takeExpired(clock::now());
+    }
+  }
+
+  // closes the idle connections and fails pending waiters, connections in use are closed once returned
+  void close() {
+    std::deque<entry> idle;
+    std::deque<std::shared_ptr<waiter>> waiters;
+    {
+#ifdef CMAKE_ENABLE_THREADING
+      std::unique_lock lock(_mutex);
+#endif
+
+      _closed = true;
+      _metrics.closed += _idle.size();
+      _size -= _idle.size();
+
+      std::swap(idle, _idle);
+      std::swap(waiters, _waiters);
+
+#ifdef CMAKE_ENABLE_THREADING
+      for (auto& w : waiters) {
+        w->cv.notify_one();
+      }
+#endif
+    }
+
+    auto error = std::make_exception_ptr(sql_error("connection pool closed"));
+    for (auto& w : waiters) {
+      if (w->resume) {
+        w->resume(error);
+      }
+    }
+  }
+
+  metrics getMetrics() {
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+
+    metrics result = _metrics;
+    result.max_size = _options.max_size;
+    result.size = _size;
+    result.idle = _idle.size();
+    result.waiting = _waiters.size();
+
+    return result;
+  }
+
+private:
+  struct entry {
+    std::shared_ptr<db::datasource::connection> connection;
+    clock::time_point created;
+    clock::time_point last_used;
+  };
+
+  // a waiter is handed an idle connection, or an empty entry if a slot was reserved for it to open one.
+  // blocking waiters are woken through cv, async ones resumed once the lock is released
+  struct waiter {
+    std::optional<entry> handed;
+    std::function<void(std::exception_ptr)> resume;
+#ifdef CMAKE_ENABLE_THREADING
+    std::condition_variable cv;
+#endif
+  };
+
+  db::datasource& _dsrc;
+  options _options;
+
+  std::deque<entry> _idle;
+  std::deque<std::shared_ptr<waiter>> _waiters;
+  size_t _size = 0;
+  bool _closed = false;
+
+  metrics _metrics;
+
 #ifdef CMAKE_ENABLE_THREADING
-    std::shared_lock rlock(_connections_mutex);
+  std::mutex _mutex;
 #endif
 
-    for (auto& connection : _connections) {
-      if (connection.use_count() > 1) {
-        continue;
+  void assertOpen() {
+    if (_closed) {
+      throw sql_error("connection pool closed");
+    }
+  }
+
+  bool expired(const entry& e, clock::time_point now) const {
+    return _options.max_lifetime.count() > 0 && now - e.created >= _options.max_lifetime;
+  }
+
+  // idle connections are reused from the back, so the least recently used ones collect at the front
+  std::list<entry> takeExpired(clock::time_point now) {
+    std::list<entry> result;
+
+    for (auto it = _idle.begin(); it != _idle.end();) {
+      bool idle_too_long = _options.idle_timeout.count() > 0 && now - it->last_used >= _options.idle_timeout &&
+          _size > _options.min_size;
+
+      if (idle_too_long || expired(*it, now)) {
+        result.push_back(std::move(*it));
+        it = _idle.erase(it);
+
+        _size -= 1;
+        _metrics.closed += 1;
+      } else {
+        ++it;
       }
+    }
+
+    return result;
+  }
+
+  // the most recently used idle connection, or an empty entry with a reserved slot, or nothing at max_size
+  std::optional<entry> take() {
+    if (!_idle.empty()) {
+      entry e = std::move(_idle.back());
+      _idle.pop_back();
+
+      return e;
+    }
+
+    if (_size < _options.max_size && _waiters.empty()) {
+      _size += 1;
+
+      return entry{};
+    }
+
+    return {};
+  }
+
+  void recordWait(clock::time_point since) {
+    auto wait = clock::now() - since;
+
+    _metrics.acquired += 1;
+    _metrics.total_wait += wait;
+    _metrics.max_wait = std::max(_metrics.max_wait, wait);
+  }
+
+  entry open() {
+    auto now = clock::now();
+    entry e{_dsrc.getConnection(), now, now};
+
+#ifdef CMAKE_ENABLE_THREADING
+    std::unique_lock lock(_mutex);
+#endif
+
+    _metrics.created += 1;
 
-      return connection;
+    return e;
+  }
+
+  bool validate(entry& e) {
+    auto now = clock::now();
+
+    if (expired(e, now)) {
+      return false;
+    }
+
+    if (_options.validation_query.empty() || now - e.last_used < _options.validation_interval) {
+      return true;
+    }
+
+    try {
+      e.connection->execute(_options.validation_query);
+      return true;
+    } catch (const std::exception&) {
+#ifdef CMAKE_ENABLE_THREADING
+      std::unique_lock lock(_mutex);
+#endif
+
+      _metrics.failed_validations += 1;
+      return false;
     }
+  }
 
+  // turns an idle entry or a reserved slot into a connection that finds its way back on release
+  std::shared_ptr<db::datasource::connection> checkout(entry e, clock::time_point since) {
+    if (e.connection && !validate(e)) {
+      {
 #ifdef CMAKE_ENABLE_THREADING
-    rlock.unlock();
-    std::unique_lock wlock(_connections_mutex);
+        std::unique_lock lock(_mutex);
 #endif
 
-    auto connection = _dsrc.getConnection();
-    _connections.push_back(connection);
+        _metrics.closed += 1;
+      }
+
+      // the slot stays reserved for the replacement
+      e = {};
+    }
 
-    return connection;
+    if (!e.connection) {
+      try {
+        e = open();
+      } catch (...) {
+        discard();
+        throw;
+      }
+    }
+
+    if (auto& on_query = _dsrc.onQuery()) {
+      on_query({query_phase::POOL_WAIT, {}, clock::now() - since});
+    }
+
+    auto native = e.connection.get();
+
+    return {native, [weak = weak_from_this(), e = std::move(e)](db::datasource::connection*) mutable {
+              if (auto self = weak.lock()) {
+                self->release(std::move(e));
+              }
+            }};
+  }
+
+  void checkout(entry e, clock::time_point since, const callback& cb) {
+    std::shared_ptr<db::datasource::connection> connection;
+
+    try {
+      connection = checkout(std::move(e), since);
+    } catch (...) {
+      cb(nullptr, std::current_exception());
+      return;
+    }
+
+    cb(connection, nullptr);
+  }
+
+  void release(entry e) {
+    e.last_used = clock::now();
+
+    std::list<entry> closing;
+    std::shared_ptr<waiter> resumed;
+    {
+#ifdef CMAKE_ENABLE_THREADING
+      std::unique_lock lock(_mutex);
+#endif
+
+      if (_closed || expired(e, e.last_used)) {
+        _size -= 1;
+        _metrics.closed += 1;
+        closing.push_back(std::move(e));
+
+        resumed = handOff({});
+      } else if (!_waiters.empty()) {
+        resumed = handOff(std::move(e));
+      } else {
+        _idle.push_back(std::move(e));
+        closing = takeExpired(clock::now());
+      }
+    }
+
+    if (resumed) {
+      resumed->resume(nullptr);
+    }
+  }
+
+  // gives up a reserved slot whose connection could not be opened, the next waiter gets to try
+  void discard() {
+    std::shared_ptr<waiter> resumed;
+    {
+#ifdef CMAKE_ENABLE_THREADING
+      std::unique_lock lock(_mutex);
+#endif
+
+      _size -= 1;
+      resumed = handOff({});
+    }
+
+    if (resumed) {
+      resumed->resume(nullptr);
+    }
+  }
+
+  // passes e to the oldest waiter, an empty e reserves a new slot if there is room.
+  // returns the waiter if it has to be resumed after the lock is released
+  std::shared_ptr<waiter> handOff(entry&& e) {
+    if (_closed || _waiters.empty()) {
+      return nullptr;
+    }
+
+    if (!e.connection) {
+      if (_size >= _options.max_size) {
+        return nullptr;
+      }
+
+      _size += 1;
+    }
+
+    auto w = std::move(_waiters.front());
+    _waiters.pop_front();
+
+    w->handed = std::move(e);
+
+    if (w->resume) {
+      return w;
+    }
+
+#ifdef CMAKE_ENABLE_THREADING
+    w->cv.notify_one();
+#endif
+
+    return nullptr;
+  }
+};
+
+class datasource : public db::datasource {
+public:
+  datasource(db::datasource& dsrc, const options& opts = {})
+      : _dsrc(dsrc), _pool(std::make_shared<pool>(dsrc, opts)) {
+    _pool->prefill();
+  }
+
+  virtual ~datasource() {
+    _pool->close();
+  }
+
+  std::shared_ptr<db::datasource::connection> getConnection() override {
+    return _pool->acquire();
+  }
+
+  void getConnection(pool::callback cb) {
+    _pool->acquire(cb);
+  }
+
+  void evictIdle() {
+    _pool->evict();
+  }
+
+  metrics getMetrics() {
+    return _pool->getMetrics();
   }
 
   std::function<void(db::connection&)>& onConnectionOpen() override {
@@ -45,12 +540,12 @@ public:
     return _dsrc.updates();
   }
 
+  instrumentation& onQuery() override {
+    return _dsrc.onQuery();
+  }
+
 private:
   db::datasource& _dsrc;
-
-  std::vector<std::shared_ptr<db::datasource::connection>> _connections;
-#ifdef CMAKE_ENABLE_THREADING
-  std::shared_mutex _connections_mutex;
-#endif
+  std::shared_ptr<pool> _pool;
 };
 } // namespace db::pooled
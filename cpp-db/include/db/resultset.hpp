@@ -5,6 +5,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace db {
 class resultset {
@@ -158,7 +159,20 @@ public:
   };
 
   explicit resultset(statement& stmt) {
+    auto since = track(stmt);
     _datasource_resultset = stmt._datasource_statement->execute();
+    tracked(since);
+  }
+
+  // fetches the rows fetch_size at a time while stepping, if the backend supports it
+  explicit resultset(statement& stmt, int fetch_size) {
+    auto since = track(stmt);
+    _datasource_resultset = stmt._datasource_statement->executeStream(fetch_size);
+    tracked(since);
+  }
+
+  explicit resultset(std::shared_ptr<datasource::resultset> datasource_resultset)
+      : _datasource_resultset(datasource_resultset) {
   }
 
   resultset(const resultset&) = delete;
@@ -169,51 +183,113 @@ public:
 
   resultset& operator=(resultset&&) = delete;
 
+  ~resultset() {
+    if (_tracking) {
+      try {
+        _tracking->on_query({query_phase::QUERY, _tracking->script, _tracking->duration, _tracking->rows,
+            _tracking->bytes});
+      } catch (...) {
+      }
+    }
+  }
+
   bool next() {
-    return _datasource_resultset->next();
+    if (!_tracking) {
+      return _datasource_resultset->next();
+    }
+
+    auto since = track();
+    bool result = _datasource_resultset->next();
+
+    if (result) {
+      _tracking->rows += 1;
+      _tracking->bytes += _datasource_resultset->rowBytes();
+    }
+
+    tracked(since);
+
+    return result;
   }
 
   template <typename T>
-  bool get(const std::string_view name, T& result) {
-    if (_datasource_resultset->isValueNull(name)) {
+  bool get(int col, T& result) {
+    if (_datasource_resultset->isValueNull(col)) {
       return false;
     }
 
     if constexpr (type_converter<T>::specialized) {
       typename type_converter<T>::db_type tmp;
 
-      _datasource_resultset->getValue(name, tmp);
+      _datasource_resultset->getValue(col, tmp);
 
       result = type_converter<T>::deserialize(tmp);
     } else {
-      _datasource_resultset->getValue(name, result);
+      _datasource_resultset->getValue(col, result);
     }
 
     return true;
   }
 
   template <typename T>
-  inline void get(const std::string_view name, std::optional<T>& result) {
+  inline bool get(const std::string_view name, T& result) {
+    return get<T>(columnIndex(name), result);
+  }
+
+  template <typename T>
+  inline void get(int col, std::optional<T>& result) {
     T value;
-    if (get<T>(name, value)) {
+    if (get<T>(col, value)) {
       result = std::move(value);
     }
   }
 
   template <typename T>
-  inline std::optional<T> get(const std::string_view name) {
+  inline void get(const std::string_view name, std::optional<T>& result) {
+    get<T>(columnIndex(name), result);
+  }
+
+  template <typename T>
+  inline std::optional<T> get(int col) {
     std::optional<T> result;
-    get<T>(name, result);
+    get<T>(col, result);
     return result;
   }
 
   template <typename T>
-  inline T value(const std::string_view name) {
+  inline std::optional<T> get(const std::string_view name) {
+    return get<T>(columnIndex(name));
+  }
+
+  template <typename T>
+  inline T value(int col) {
     T result;
-    get<T>(name, result);
+    get<T>(col, result);
     return result;
   }
 
+  template <typename T>
+  inline T value(const std::string_view name) {
+    return value<T>(columnIndex(name));
+  }
+
+  int columnIndex(const std::string_view name) {
+    return _datasource_resultset->columnIndex(name);
+  }
+
+  // resolves the columns of fields once per resultset
+  const std::vector<int>& columnIndices(const orm::field_info* fields, size_t fields_len) {
+    if (_column_fields != fields) {
+      _column_fields = fields;
+      _column_indices.resize(fields_len);
+
+      for (size_t i = 0; i < fields_len; i++) {
+        _column_indices[i] = columnIndex(fields[i].name);
+      }
+    }
+
+    return _column_indices;
+  }
+
   polymorphic_field operator[](const std::string_view name) {
     return polymorphic_field(*this, name);
   }
@@ -252,7 +328,43 @@ public:
   }
 
 private:
+  // only kept while the statement's datasource is instrumented, adds up the execution and every call of next
+  struct tracking {
+    instrumentation& on_query;
+    std::string script;
+    query_event::clock::duration duration{0};
+    int64_t rows = 0;
+    uint64_t bytes = 0;
+  };
+
   std::shared_ptr<datasource::resultset> _datasource_resultset;
+
+  const orm::field_info* _column_fields = nullptr;
+  std::vector<int> _column_indices;
+
+  std::unique_ptr<tracking> _tracking;
+
+  query_event::clock::time_point track(statement& stmt) {
+    if (stmt._script.empty()) {
+      return {};
+    }
+
+    if (auto on_query = stmt.listener()) {
+      _tracking.reset(new tracking{*on_query, stmt._script});
+    }
+
+    return track();
+  }
+
+  query_event::clock::time_point track() {
+    return _tracking ? query_event::clock::now() : query_event::clock::time_point{};
+  }
+
+  void tracked(query_event::clock::time_point since) {
+    if (_tracking) {
+      _tracking->duration += query_event::clock::now() - since;
+    }
+  }
 };
 
 template <typename T>
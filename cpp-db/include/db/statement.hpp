@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace db {
 class statement {
@@ -17,6 +18,9 @@ public:
     explicit parameter(statement& stmt, const std::string_view name) : _stmt(stmt), _name(name) {
     }
 
+    explicit parameter(statement& stmt, int index) : _stmt(stmt), _index(index) {
+    }
+
     parameter(const parameter&) = delete;
 
     parameter(parameter&&) = default;
@@ -95,6 +99,7 @@ public:
   private:
     std::reference_wrapper<statement> _stmt;
     std::string _name;
+    int _index = -1;
 
     template <typename T>
     void setValueByOptional(const std::optional<T>& value) {
@@ -112,12 +117,22 @@ public:
     template <typename T>
     void setValue(const T& value) {
       _stmt.get().assertPrepared();
-      _stmt.get()._datasource_statement->setParam(_name, value);
+
+      if (_name.empty()) {
+        _stmt.get()._datasource_statement->setParam(_index, value);
+      } else {
+        _stmt.get()._datasource_statement->setParam(_name, value);
+      }
     }
 
     void setNull() {
       _stmt.get().assertPrepared();
-      _stmt.get()._datasource_statement->setParamToNull(_name);
+
+      if (_name.empty()) {
+        _stmt.get()._datasource_statement->setParamToNull(_index);
+      } else {
+        _stmt.get()._datasource_statement->setParamToNull(_name);
+      }
     }
   };
 
@@ -130,6 +145,10 @@ public:
       return *(_current_parameter = statement::parameter(_stmt, name));
     }
 
+    parameter& operator[](int index) {
+      return *(_current_parameter = statement::parameter(_stmt, index));
+    }
+
   private:
     std::reference_wrapper<statement> _stmt;
     std::optional<parameter> _current_parameter;
@@ -149,7 +168,19 @@ public:
   statement& operator=(statement&&) = delete;
 
   void prepare(const std::string_view script) {
+    auto on_query = listener();
+    auto since = on_query ? query_event::clock::now() : query_event::clock::time_point{};
+
     _datasource_statement = _conn.get()._datasource_connection->prepareStatement(script);
+    _parameter_fields = nullptr;
+
+    // the script is only kept while someone listens to the datasource
+    if (on_query) {
+      _script = script;
+      (*on_query)({query_phase::PREPARE, _script, query_event::clock::now() - since});
+    } else {
+      _script.clear();
+    }
   }
 
   bool prepared() {
@@ -165,7 +196,40 @@ public:
   int executeUpdate() {
     assertPrepared();
 
-    return _datasource_statement->executeUpdate();
+    auto on_query = _script.empty() ? nullptr : listener();
+    if (!on_query) {
+      return _datasource_statement->executeUpdate();
+    }
+
+    auto since = query_event::clock::now();
+    int rows = _datasource_statement->executeUpdate();
+    (*on_query)({query_phase::EXECUTE, _script, query_event::clock::now() - since, rows});
+
+    return rows;
+  }
+
+  int parameterIndex(const std::string_view name) {
+    assertPrepared();
+
+    return _datasource_statement->parameterIndex(name);
+  }
+
+  // resolves the ":name" parameters of fields once per prepared statement
+  const std::vector<int>& parameterIndices(const orm::field_info* fields, size_t fields_len) {
+    if (_parameter_fields != fields) {
+      _parameter_fields = fields;
+      _parameter_indices.resize(fields_len);
+
+      for (size_t i = 0; i < fields_len; i++) {
+        _parameter_indices[i] = parameterIndex(std::string{":"} + fields[i].name);
+      }
+    }
+
+    return _parameter_indices;
+  }
+
+  connection& getConnection() noexcept {
+    return _conn.get();
   }
 
   template <typename T = datasource::statement>
@@ -176,5 +240,16 @@ public:
 protected:
   std::reference_wrapper<connection> _conn;
   std::shared_ptr<datasource::statement> _datasource_statement;
+
+private:
+  const orm::field_info* _parameter_fields = nullptr;
+  std::vector<int> _parameter_indices;
+  std::string _script;
+
+  instrumentation* listener() {
+    auto& on_query = _conn.get()._dsrc.onQuery();
+
+    return on_query ? &on_query : nullptr;
+  }
 };
 } // namespace db
@@ -8,10 +8,12 @@
 #include "./uvpp/handle.hpp"
 #include "./uvpp/loop.hpp"
 #include "./uvpp/misc.hpp"
+#include "./uvpp/poll.hpp"
 #include "./uvpp/req.hpp"
 #include "./uvpp/stream.hpp"
 #include "./uvpp/tcp.hpp"
 #include "./uvpp/threading.hpp"
+#include "./uvpp/timer-wheel.hpp"
 #include "./uvpp/timer.hpp"
 #include "./uvpp/tty.hpp"
 #include "./uvpp/work.hpp"
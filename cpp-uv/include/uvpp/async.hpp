@@ -3,29 +3,41 @@
 #include "./error.hpp"
 #include "./handle.hpp"
 #include "uv.h"
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
 
 namespace uv {
 struct async : public handle {
 public:
+  using native_type = uv_async_t;
+
   struct data : public handle::data {
+    struct send_node {
+      send_node* next;
+      std::function<void()> cb;
+    };
+
     uv_async_t* _native_async;
     std::function<void()> async_cb;
+    std::atomic<send_node*> sends = nullptr;
 
     data(uv_async_t* native_async) : _native_async(native_async) {
     }
 
     virtual ~data() {
+      send_node* head = sends.exchange(nullptr, std::memory_order_acquire);
+      while (head) {
+        delete std::exchange(head, head->next);
+      }
+
       delete _native_async;
     }
   };
 
-  async(uv_loop_t* native_loop, uv_async_t* native_async)
-      : handle(native_async, new data(native_async)), _native_async(native_async) {
-    error::test(uv_async_init(native_loop, native_async, [](uv_async_t* native_async) {
-      data* data_ptr = handle::getData<data>(native_async);
-      data_ptr->async_cb();
-    }));
+  async(uv_loop_t* native_loop, uv_async_t* native_async) : async(native_loop, native_async, new data(native_async)) {
   }
 
   async(uv_loop_t* native_loop) : async(native_loop, new uv_async_t()) {
@@ -50,9 +62,15 @@ public:
     return _native_async;
   }
 
+  // may be called from any thread. libuv coalesces wakeups, so every callback passed to send is kept and runs once
+  // on the loop thread, in the order sent, before the callback of start
   void send(std::function<void()> async_cb) {
     data* data_ptr = getData<data>();
-    data_ptr->async_cb = async_cb;
+
+    auto n = new data::send_node{nullptr, std::move(async_cb)};
+    n->next = data_ptr->sends.load(std::memory_order_relaxed);
+    while (!data_ptr->sends.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed)) {
+    }
 
     error::test(uv_async_send(*this));
   }
@@ -65,14 +83,14 @@ public:
   }
 #endif
 
-  static void queue(std::function<void()> cb) {
-    uv::async* async = new uv::async();
-    async->send([async, cb{std::move(cb)}]() {
-      delete async;
-      cb();
-    });
+  // async_cb runs on every wakeup, i.e. at least once after any number of sends
+  void start(std::function<void()> async_cb) {
+    data* data_ptr = getData<data>();
+    data_ptr->async_cb = async_cb;
   }
 
+  static void queue(std::function<void()> cb);
+
 #ifndef UVPP_NO_TASK
   static task<void> queue() {
     return task<void>::create([](auto& resolve, auto& reject) {
@@ -81,7 +99,181 @@ public:
   }
 #endif
 
+protected:
+  async(uv_loop_t* native_loop, uv_async_t* native_async, data* data_ptr)
+      : handle(native_async, data_ptr), _native_async(native_async) {
+    error::test(uv_async_init(native_loop, native_async, [](uv_async_t* native_async) {
+      data* data_ptr = handle::getData<data>(native_async);
+
+      data::send_node* head = data_ptr->sends.exchange(nullptr, std::memory_order_acquire);
+      data::send_node* batch = nullptr;
+      while (head) {
+        data::send_node* n = std::exchange(head, head->next);
+        n->next = batch;
+        batch = n;
+      }
+
+      while (batch) {
+        std::unique_ptr<data::send_node> n{std::exchange(batch, batch->next)};
+        n->cb();
+      }
+
+      if (data_ptr->async_cb) {
+        data_ptr->async_cb();
+      }
+    }));
+  }
+
 private:
   uv_async_t* _native_async;
 };
+
+struct async_queue {
+public:
+  async_queue(uv_loop_t* native_loop = uv_default_loop()) : _async(native_loop), _owner(uv_thread_self()) {
+    _async.start([this]() {
+      drain();
+    });
+
+    uv_unref(_async);
+  }
+
+  async_queue(const async_queue&) = delete;
+
+  async_queue& operator=(const async_queue&) = delete;
+
+  ~async_queue() noexcept {
+    node* head = _head.exchange(nullptr, std::memory_order_acquire);
+
+    while (head) {
+      delete std::exchange(head, head->next);
+    }
+  }
+
+  // callbacks run on the loop thread in the order they were posted. the handle is referenced while callbacks are
+  // pending, but uv_ref is only safe on the loop thread: other threads have to keep the loop alive themselves
+  // until their post is picked up, e.g. by posting from uv::work or while another handle is active
+  void post(std::function<void()> cb) {
+    std::unique_ptr<node> n{new node{nullptr, std::move(cb)}};
+
+    // close waits for posts that got past the check, so that none of them sends to a closed handle
+    _posting.fetch_add(1);
+    if (_closed.load()) {
+      _posting.fetch_sub(1);
+      throw uv::error{UV_ECANCELED};
+    }
+
+    _pending.fetch_add(1, std::memory_order_relaxed);
+
+    node* next = _head.load(std::memory_order_relaxed);
+
+    do {
+      n->next = next;
+    } while (!_head.compare_exchange_weak(next, n.get(), std::memory_order_release, std::memory_order_relaxed));
+    n.release();
+
+    if (isOwnerThread()) {
+      uv_ref(_async);
+    }
+
+    int status = next == nullptr ? uv_async_send(_async) : 0;
+    _posting.fetch_sub(1, std::memory_order_release);
+
+    error::test(status);
+  }
+
+#ifndef UVPP_NO_TASK
+  task<void> schedule() {
+    return task<void>::create([this](auto& resolve, auto& reject) {
+      post(resolve);
+    });
+  }
+#endif
+
+  bool isOwnerThread() const noexcept {
+    uv_thread_t self = uv_thread_self();
+    return uv_thread_equal(&self, &_owner) != 0;
+  }
+
+  // closes the handle once the callbacks still queued ran, so that the loop can be closed. posting afterwards
+  // throws, posts other threads are in the middle of are waited for and run
+  void close(std::function<void()> close_cb) {
+    _closed.store(true);
+
+    while (_posting.load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+
+    drain();
+    _async.close(std::move(close_cb));
+  }
+
+  // the queue of the default loop. uv::run creates it on the loop thread, code running before uv::run has to
+  // post on that same thread
+  static async_queue& getDefault() {
+    auto& default_queue = defaultQueue();
+    if (!default_queue) {
+      default_queue = new async_queue(uv_default_loop());
+    }
+
+    return *default_queue;
+  }
+
+  // closes and frees the default queue, the loop has to run once more to finish the close
+  static void closeDefault() {
+    auto default_queue = std::exchange(defaultQueue(), nullptr);
+    if (default_queue) {
+      default_queue->close([default_queue]() {
+        delete default_queue;
+      });
+    }
+  }
+
+private:
+  struct node {
+    node* next;
+    std::function<void()> cb;
+  };
+
+  uv::async _async;
+  uv_thread_t _owner;
+  std::atomic<node*> _head = nullptr;
+  std::atomic<size_t> _pending = 0;
+  // posts between their check of _closed and their uv_async_send
+  std::atomic<size_t> _posting = 0;
+  std::atomic<bool> _closed = false;
+
+  static async_queue*& defaultQueue() {
+    static async_queue* default_queue = nullptr;
+    return default_queue;
+  }
+
+  void drain() {
+    node* head = _head.exchange(nullptr, std::memory_order_acquire);
+
+    node* batch = nullptr;
+    while (head) {
+      node* n = std::exchange(head, head->next);
+      n->next = batch;
+      batch = n;
+    }
+
+    while (batch) {
+      std::unique_ptr<node> n{std::exchange(batch, batch->next)};
+      _pending.fetch_sub(1, std::memory_order_relaxed);
+      n->cb();
+    }
+
+    // callbacks posted by other threads since the exchange keep the loop alive until their wakeup is handled
+    if (_pending.load(std::memory_order_relaxed) == 0) {
+      uv_unref(_async);
+    } else {
+      uv_ref(_async);
+    }
+  }
+};
+
+void async::queue(std::function<void()> cb) {
+  async_queue::getDefault().post(std::move(cb));
+}
 } // namespace uv
@@ -8,6 +8,8 @@
 namespace uv {
 struct check : public handle {
 public:
+  using native_type = uv_check_t;
+
   struct data : public handle::data {
     uv_check_t* _native_check;
     std::function<void()> check_cb;
@@ -20,9 +22,7 @@ public:
     }
   };
 
-  check(uv_loop_t* native_loop, uv_check_t* native_check)
-      : handle(native_check, new data(native_check)), _native_check(native_check) {
-    error::test(uv_check_init(native_loop, native_check));
+  check(uv_loop_t* native_loop, uv_check_t* native_check) : check(native_loop, native_check, new data(native_check)) {
   }
 
   check(uv_loop_t* native_loop) : check(native_loop, new uv_check_t()) {
@@ -61,6 +61,12 @@ public:
     error::test(uv_check_stop(*this));
   }
 
+protected:
+  check(uv_loop_t* native_loop, uv_check_t* native_check, data* data_ptr)
+      : handle(native_check, data_ptr), _native_check(native_check) {
+    error::test(uv_check_init(native_loop, native_check));
+  }
+
 private:
   uv_check_t* _native_check;
 };
@@ -62,12 +62,13 @@ void open(const char* path, int flags, int mode, std::function<void(uv::file, uv
   error::test(uv_fs_open(native_loop, *req, path, flags, mode, [](uv_fs_t* req) {
     auto data = req_t::dataPtr(req);
     auto cb = std::move(data->cb);
+    auto result = req->result;
     delete data->req;
 
-    if (req->result < 0) {
-      cb(0, uv::error{(int)req->result});
+    if (result < 0) {
+      cb(0, uv::error{(int)result});
     } else {
-      cb(req->result, uv::error{0});
+      cb(result, uv::error{0});
     }
   }));
 }
@@ -151,6 +152,49 @@ task<std::string_view> read(uv::file file, char* buf = nullptr, size_t buf_len =
 }
 #endif
 
+void sendfile(uv::file out_file, uv::file in_file, int64_t offset, size_t length,
+    std::function<void(size_t, uv::error)> cb, uv_loop_t* native_loop = uv_default_loop()) {
+  struct data_t : public uv::detail::req::data {
+    std::function<void(size_t, uv::error)> cb;
+  };
+  using req_t = uv::req<uv_fs_t, data_t>;
+
+  auto req = new req_t(&uv_fs_req_cleanup);
+  auto data = req->dataPtr();
+  data->cb = cb;
+
+  error::test(uv_fs_sendfile(native_loop, *req, out_file, in_file, offset, length, [](uv_fs_t* req) {
+    auto data = req_t::dataPtr(req);
+    auto cb = std::move(data->cb);
+    auto result = req->result;
+    delete data->req;
+
+    if (result < 0) {
+      cb(0, uv::error{(int)result});
+    } else {
+      cb((size_t)result, uv::error{0});
+    }
+  }));
+}
+
+#ifndef UVPP_NO_TASK
+task<size_t> sendfile(
+    uv::file out_file, uv::file in_file, int64_t offset, size_t length, uv_loop_t* native_loop = uv_default_loop()) {
+  return task<size_t>::create([out_file, in_file, offset, length, native_loop](auto& resolve, auto& reject) {
+    uv::fs::sendfile(
+        out_file, in_file, offset, length,
+        [&resolve, &reject](auto result, auto error) {
+          if (error) {
+            reject(make_exception_ptr(error));
+          } else {
+            resolve(result);
+          }
+        },
+        native_loop);
+  });
+}
+#endif
+
 #ifndef UVPP_NO_TASK
 task<std::string> readAll(uv::file file, int64_t offset = 0, uv_loop_t* native_loop = uv_default_loop()) {
   std::string result;
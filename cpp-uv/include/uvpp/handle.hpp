@@ -5,11 +5,13 @@
 #endif
 #include "uv.h"
 #include <functional>
+#include <utility>
 
 namespace uv {
 struct handle {
 public:
   struct data {
+    bool embedded = false;
     std::function<void()> close_cb;
 
     virtual ~data() {
@@ -35,6 +37,10 @@ public:
   virtual ~handle() noexcept {
     data* data_ptr = getData<data>();
 
+    if (data_ptr->embedded) {
+      return;
+    }
+
     if (isClosing()) {
       delete data_ptr;
     } else {
@@ -52,6 +58,10 @@ public:
     return _native_handle;
   }
 
+  uv_loop_t* loop() const noexcept {
+    return _native_handle->loop;
+  }
+
   bool isActive() const noexcept {
     return uv_is_active(*this) != 0;
   }
@@ -66,7 +76,8 @@ public:
 
     uv_close(*this, [](uv_handle_t* native_handle) {
       data* data_ptr = handle::getData<data>(native_handle);
-      data_ptr->close_cb();
+      auto close_cb = std::move(data_ptr->close_cb);
+      close_cb();
     });
   }
 
@@ -98,4 +109,50 @@ protected:
 private:
   uv_handle_t* _native_handle;
 };
+
+namespace detail {
+template <typename N, typename D>
+struct embedded_storage {
+  N _embedded_native = {};
+  D _embedded_data{nullptr};
+
+  embedded_storage() {
+    _embedded_data.embedded = true;
+  }
+};
+} // namespace detail
+
+template <typename H>
+struct embedded final : private detail::embedded_storage<typename H::native_type, typename H::data>, public H {
+public:
+  using storage = detail::embedded_storage<typename H::native_type, typename H::data>;
+
+  template <typename... A>
+  static embedded* create(uv_loop_t* native_loop = uv_default_loop(), A&&... args) {
+    return new embedded(native_loop, std::forward<A>(args)...);
+  }
+
+  embedded(const embedded&) = delete;
+
+  embedded(embedded&&) = delete;
+
+  void destroy() noexcept {
+    if (this->isClosing()) {
+      return;
+    }
+
+    this->close([this]() {
+      delete this;
+    });
+  }
+
+private:
+  template <typename... A>
+  embedded(uv_loop_t* native_loop, A&&... args)
+      : storage(), H(native_loop, &this->_embedded_native, &this->_embedded_data, std::forward<A>(args)...) {
+  }
+
+  ~embedded() noexcept {
+  }
+};
 } // namespace uv
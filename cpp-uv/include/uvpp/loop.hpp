@@ -1,9 +1,12 @@
 #pragma once
 
+#include "./async.hpp"
 #include "uv.h"
 
 namespace uv {
 void run() {
+  async_queue::getDefault();
+
   uv_run(uv_default_loop(), UV_RUN_DEFAULT);
 }
 } // namespace uv
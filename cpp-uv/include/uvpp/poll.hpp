@@ -0,0 +1,95 @@
+#pragma once
+
+#include "./error.hpp"
+#include "./handle.hpp"
+#ifndef UVPP_NO_TASK
+#include "../task.hpp"
+#endif
+#include "uv.h"
+#include <functional>
+
+namespace uv {
+struct poll : public handle {
+public:
+  using native_type = uv_poll_t;
+
+  struct data : public handle::data {
+    uv_poll_t* _native_poll;
+    std::function<void(int, uv::error)> poll_cb;
+
+    data(uv_poll_t* native_poll) : _native_poll(native_poll) {
+    }
+
+    virtual ~data() {
+      delete _native_poll;
+    }
+  };
+
+  poll(uv_os_sock_t socket, uv_loop_t* native_loop, uv_poll_t* native_poll)
+      : poll(native_loop, native_poll, new data(native_poll), socket) {
+  }
+
+  poll(uv_os_sock_t socket, uv_loop_t* native_loop) : poll(socket, native_loop, new uv_poll_t()) {
+  }
+
+  poll(uv_os_sock_t socket, uv_poll_t* native_poll) : poll(socket, uv_default_loop(), native_poll) {
+  }
+
+  poll(uv_os_sock_t socket) : poll(socket, uv_default_loop(), new uv_poll_t()) {
+  }
+
+  operator uv_poll_t*() noexcept {
+    return _native_poll;
+  }
+
+  operator const uv_poll_t*() const noexcept {
+    return _native_poll;
+  }
+
+  void start(int events, std::function<void(int, uv::error)> poll_cb) {
+    data* data_ptr = getData<data>();
+    data_ptr->poll_cb = poll_cb;
+
+    error::test(uv_poll_start(*this, events, [](uv_poll_t* native_poll, int status, int events) {
+      data* data_ptr = handle::getData<data>(native_poll);
+
+      // the callback may restart or stop the poll, so it must not run from inside data_ptr
+      auto poll_cb = std::move(data_ptr->poll_cb);
+      poll_cb(events, uv::error{status});
+
+      if (!data_ptr->poll_cb && uv_is_active((uv_handle_t*)native_poll)) {
+        data_ptr->poll_cb = std::move(poll_cb);
+      }
+    }));
+  }
+
+#ifndef UVPP_NO_TASK
+  task<int> startOnce(int events) {
+    return task<int>::create([this, events](auto& resolve, auto& reject) {
+      start(events, [this, &resolve, &reject](int events, uv::error error) {
+        stop();
+
+        if (error) {
+          reject(std::make_exception_ptr(error));
+        } else {
+          resolve(events);
+        }
+      });
+    });
+  }
+#endif
+
+  void stop() {
+    error::test(uv_poll_stop(*this));
+  }
+
+protected:
+  poll(uv_loop_t* native_loop, uv_poll_t* native_poll, data* data_ptr, uv_os_sock_t socket)
+      : handle(native_poll, data_ptr), _native_poll(native_poll) {
+    error::test(uv_poll_init_socket(native_loop, native_poll, socket));
+  }
+
+private:
+  uv_poll_t* _native_poll;
+};
+} // namespace uv
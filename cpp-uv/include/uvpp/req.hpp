@@ -3,6 +3,8 @@
 #include "./error.hpp"
 #include "uv.h"
 #include <functional>
+#include <new>
+#include <utility>
 
 namespace uv {
 namespace detail {
@@ -16,11 +18,7 @@ public:
   };
 
   req(uv_req_t* native_req, data* data_ptr) : _native_req(native_req) {
-#if (UV_VERSION_MAJOR >= 1) && (UV_VERSION_MINOR >= 34)
-    uv_req_set_data(native_req, data_ptr);
-#else
-    native_req->data = (void*)data_ptr;
-#endif
+    setData(data_ptr);
   }
 
   template <typename T>
@@ -47,6 +45,21 @@ public:
   }
 
 protected:
+  req(uv_req_t* native_req) : _native_req(native_req) {
+  }
+
+  template <typename T>
+  req(T* native_req) : req(reinterpret_cast<uv_req_t*>(native_req)) {
+  }
+
+  void setData(data* data_ptr) noexcept {
+#if (UV_VERSION_MAJOR >= 1) && (UV_VERSION_MINOR >= 34)
+    uv_req_set_data(_native_req, data_ptr);
+#else
+    _native_req->data = (void*)data_ptr;
+#endif
+  }
+
   template <typename R, typename T>
   static R* getData(const T* native_req) {
 #if (UV_VERSION_MAJOR >= 1) && (UV_VERSION_MINOR >= 34)
@@ -64,6 +77,71 @@ protected:
 private:
   uv_req_t* _native_req;
 };
+
+struct req_pool_stats_t {
+  size_t allocations = 0;
+  size_t reuses = 0;
+  size_t cached = 0;
+};
+
+inline thread_local req_pool_stats_t req_pool_stats;
+
+// blocks come from ::operator new, so a req allocated on one thread and deleted on another, e.g. by a loop running
+// elsewhere, just moves into the list of the deleting thread. every thread caches at most max_cached blocks
+template <typename T>
+struct free_list {
+public:
+  static constexpr size_t max_cached = 1024;
+
+  free_list() = default;
+
+  free_list(const free_list&) = delete;
+
+  ~free_list() noexcept {
+    while (_head) {
+      req_pool_stats.cached -= 1;
+      ::operator delete(std::exchange(_head, _head->next));
+    }
+  }
+
+  void* allocate(std::size_t size) {
+    if (!_head || size != sizeof(T)) {
+      req_pool_stats.allocations += 1;
+      return ::operator new(size);
+    }
+
+    req_pool_stats.reuses += 1;
+    req_pool_stats.cached -= 1;
+    _cached -= 1;
+
+    return std::exchange(_head, _head->next);
+  }
+
+  void release(void* ptr, std::size_t size) noexcept {
+    if (size != sizeof(T) || _cached >= max_cached) {
+      ::operator delete(ptr);
+      return;
+    }
+
+    req_pool_stats.cached += 1;
+    _cached += 1;
+
+    _head = new (ptr) node{_head};
+  }
+
+private:
+  struct node {
+    node* next;
+  };
+
+  static_assert(sizeof(T) >= sizeof(node));
+
+  node* _head = nullptr;
+  size_t _cached = 0;
+};
+
+template <typename T>
+inline thread_local free_list<T> req_pool;
 } // namespace detail
 
 template <typename N, typename D>
@@ -71,32 +149,26 @@ struct req : public uv::detail::req {
 public:
   using C = void (*)(N*);
 
-  req(N* native, C cleanup) : uv::detail::req(native, new D()), _native(native), _cleanup(cleanup) {
-    dataPtr()->req = this;
-  }
-
-  req(C cleanup) : req(new N(), cleanup) {
+  req(C cleanup) : uv::detail::req(&_native), _cleanup(cleanup) {
+    setData(&_data);
+    _data.req = this;
   }
 
-  req() : req(new N(), nullptr) {
+  req() : req(nullptr) {
   }
 
   virtual ~req() noexcept {
-    delete dataPtr();
-
     if (_cleanup) {
-      _cleanup(_native);
+      _cleanup(&_native);
     }
-
-    delete _native;
   }
 
   operator N*() noexcept {
-    return _native;
+    return &_native;
   }
 
   operator const N*() const noexcept {
-    return _native;
+    return &_native;
   }
 
   D* dataPtr() {
@@ -107,8 +179,29 @@ public:
     return getData<D>(native_fs);
   }
 
+  static void* operator new(std::size_t size) {
+    return uv::detail::req_pool<req>.allocate(size);
+  }
+
+  static void operator delete(void* ptr, std::size_t size) noexcept {
+    uv::detail::req_pool<req>.release(ptr, size);
+  }
+
 private:
-  N* _native;
+  N _native = {};
+  D _data;
   C _cleanup = nullptr;
 };
+
+struct req_stats {
+  size_t allocations;
+  size_t reuses;
+  size_t cached;
+};
+
+req_stats reqStats() noexcept {
+  auto& stats = uv::detail::req_pool_stats;
+
+  return {stats.allocations, stats.reuses, stats.cached};
+}
 } // namespace uv
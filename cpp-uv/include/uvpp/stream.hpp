@@ -10,10 +10,12 @@
 #include "../ssl.hpp"
 #endif
 #include "uv.h"
+#include <algorithm>
 #include <functional>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace uv {
 struct stream : public handle {
@@ -21,11 +23,20 @@ public:
   struct data : public handle::data {
     bool sent_eof = false;
 
+    size_t high_water_mark = 65536;
+    size_t low_water_mark = 16384;
+    bool needs_drain = false;
+
+    // set while tcp::sendFile hands the socket to the threadpool, other writes would interleave with the file
+    bool sending_file = false;
+
     std::function<void(uv::error)> connection_cb;
     std::function<void(std::string_view, uv::error)> read_cb;
 #ifndef UVPP_NO_SSL
     std::function<void(std::string_view, uv::error)> read_decrypted_cb;
 #endif
+    std::function<void()> writable_cb;
+    std::vector<std::function<void(uv::error)>> drain_cbs;
   };
 
   stream(uv_stream_t* native_stream, data* data_ptr) : handle(native_stream, data_ptr), _native_stream(native_stream) {
@@ -57,8 +68,13 @@ public:
     auto data_ptr = getData<data>();
     if (!data_ptr->sent_eof) {
       data_ptr->sent_eof = true;
-      data_ptr->read_cb({}, uv::error{UV_EOF});
+
+      if (data_ptr->read_cb) {
+        data_ptr->read_cb({}, uv::error{UV_EOF});
+      }
     }
+
+    failDrain(data_ptr, uv::error{UV_ECANCELED});
   }
 
   void shutdown(std::function<void(uv::error)> cb) {
@@ -322,56 +338,48 @@ public:
   }
 #endif
 
+  // tries uv_try_write first: when all of input goes out at once, or the attempt fails with a hard error, cb runs
+  // before write returns, so callers must not hold state across write that cb may change. only a remainder that
+  // could not be written right away is queued and completes from the loop. while tcp::sendFile runs without ssl,
+  // writes fail with UV_EBUSY
 #ifndef UVPP_NO_SSL
   void write(std::string&& input, std::function<void(uv::error)> cb, bool encrypted = true) {
+    if (_ssl_state && encrypted) {
+      encrypt(input, cb);
+      return;
+    }
 #else
   void write(std::string&& input, std::function<void(uv::error)> cb) {
 #endif
-    auto _write = [this](std::string&& input, std::function<void(uv::error)>& cb) {
-      struct data_t : public uv::detail::req::data {
-        std::string input;
-        std::function<void(uv::error)> cb;
-      };
-      using req_t = uv::req<uv_write_t, data_t>;
-
-      auto req = new req_t();
-      auto data = req->dataPtr();
-      data->input = std::move(input);
-      data->cb = cb;
-
-      uv_buf_t buf = uv_buf_init(data->input.data(), data->input.length());
-
-      error::test(uv_write(*req, *this, &buf, 1, [](uv_write_t* req, int status) {
-        auto data = req_t::dataPtr(req);
-        auto cb = std::move(data->cb);
-        delete data->req;
-
-        cb(uv::error{status});
-      }));
-    };
+    writeNative(input, &input, cb);
+  }
 
+  // like write, but input is not copied: the caller keeps it alive and unchanged until cb ran
 #ifndef UVPP_NO_SSL
+  void writeView(std::string_view input, std::function<void(uv::error)> cb, bool encrypted = true) {
     if (_ssl_state && encrypted) {
-      _ssl_state.encrypt(std::move(input), [cb{std::move(cb)}](auto error) {
-        if (error) {
-          try {
-            std::rethrow_exception(error);
-          } catch (const uv::error& e) {
-            cb(e);
-          }
-        } else {
-          cb(uv::error{0});
-        }
-      });
-    } else {
-      _write(std::move(input), cb);
+      encrypt(input, cb);
+      return;
     }
 #else
-    _write(std::move(input), cb);
+  void writeView(std::string_view input, std::function<void(uv::error)> cb) {
 #endif
+    writeNative(input, nullptr, cb);
   }
 
 #ifndef UVPP_NO_TASK
+  task<void> writeView(std::string_view input) {
+    return task<void>::create([this, input](auto& resolve, auto& reject) {
+      writeView(input, [&resolve, &reject](auto error) {
+        if (error) {
+          reject(std::make_exception_ptr(error));
+        } else {
+          resolve();
+        }
+      });
+    });
+  }
+
   task<void> write(std::string&& input) {
     return task<void>::create([this, input{std::move(input)}](auto& resolve, auto& reject) mutable {
       write(std::move(input), [&resolve, &reject](auto error) {
@@ -385,6 +393,51 @@ public:
   }
 #endif
 
+  size_t writeQueueSize() const noexcept {
+    return uv_stream_get_write_queue_size(*this);
+  }
+
+  void setWaterMarks(size_t high_water_mark, size_t low_water_mark) {
+    auto data_ptr = getData<data>();
+    data_ptr->high_water_mark = high_water_mark;
+    data_ptr->low_water_mark = std::min(low_water_mark, high_water_mark);
+  }
+
+  bool needsDrain() {
+    return getData<data>()->needs_drain;
+  }
+
+  void onWritable(std::function<void()> cb) {
+    getData<data>()->writable_cb = std::move(cb);
+  }
+
+  // cb gets an error when the stream is closed or a write fails before the queue drained. with ssl only encrypted
+  // data handed to the socket counts, data the driver still holds (e.g. during the handshake) does not
+  void drain(std::function<void(uv::error)> cb) {
+    auto data_ptr = getData<data>();
+
+    if (!data_ptr->needs_drain) {
+      cb(uv::error{0});
+      return;
+    }
+
+    data_ptr->drain_cbs.push_back(std::move(cb));
+  }
+
+#ifndef UVPP_NO_TASK
+  task<void> drain() {
+    return task<void>::create([this](auto& resolve, auto& reject) {
+      drain([&resolve, &reject](auto error) {
+        if (error) {
+          reject(std::make_exception_ptr(error));
+        } else {
+          resolve();
+        }
+      });
+    });
+  }
+#endif
+
   bool isReadable() const noexcept {
     return uv_is_readable(*this) != 0;
   }
@@ -412,5 +465,121 @@ protected:
 
 private:
   uv_stream_t* _native_stream;
+
+#ifndef UVPP_NO_SSL
+  // the driver consumes input before returning, the encrypted output is written as it becomes available
+  void encrypt(std::string_view input, std::function<void(uv::error)>& cb) {
+    _ssl_state.encrypt(input, [cb{std::move(cb)}](auto error) {
+      if (error) {
+        try {
+          std::rethrow_exception(error);
+        } catch (const uv::error& e) {
+          cb(e);
+        }
+      } else {
+        cb(uv::error{0});
+      }
+    });
+  }
+#endif
+
+  // input points into owned when write took ownership of it, the remainder then moves into the request.
+  // otherwise the caller keeps input alive until cb ran
+  void writeNative(std::string_view input, std::string* owned, std::function<void(uv::error)>& cb) {
+    struct data_t : public uv::detail::req::data {
+      std::string input;
+      std::function<void(uv::error)> cb;
+    };
+    using req_t = uv::req<uv_write_t, data_t>;
+
+    if (getData<stream::data>()->sending_file) {
+      cb(uv::error{UV_EBUSY});
+      return;
+    }
+
+    uv_buf_t try_buf = uv_buf_init(const_cast<char*>(input.data()), input.length());
+    int written = uv_try_write(*this, &try_buf, 1);
+
+    if (written < 0 && written != UV_EAGAIN && written != UV_ENOSYS) {
+      failDrain(getData<stream::data>(), uv::error{written});
+      cb(uv::error{written});
+      return;
+    } else if (written < 0) {
+      written = 0;
+    }
+
+    if ((size_t)written == input.length() && written != 0) {
+      cb(uv::error{0});
+      return;
+    }
+
+    auto req = new req_t();
+    auto data = req->dataPtr();
+    data->cb = cb;
+
+    const char* base = input.data();
+    if (owned) {
+      data->input = std::move(*owned);
+      base = data->input.data();
+    }
+
+    uv_buf_t buf = uv_buf_init(const_cast<char*>(base) + written, input.length() - written);
+
+    error::test(uv_write(*req, *this, &buf, 1, [](uv_write_t* req, int status) {
+      auto data = req_t::dataPtr(req);
+      auto cb = std::move(data->cb);
+      auto native_stream = req->handle;
+      delete data->req;
+
+      if (status < 0) {
+        stream::failDrain(handle::getData<stream::data>(native_stream), uv::error{status});
+      } else {
+        stream::checkWritable(native_stream);
+      }
+
+      cb(uv::error{status});
+    }));
+
+    auto data_ptr = getData<stream::data>();
+    if (writeQueueSize() > data_ptr->high_water_mark) {
+      data_ptr->needs_drain = true;
+    }
+  }
+
+  static void checkWritable(uv_stream_t* native_stream) {
+    auto data_ptr = handle::getData<data>(native_stream);
+
+    if (!data_ptr->needs_drain || uv_stream_get_write_queue_size(native_stream) > data_ptr->low_water_mark) {
+      return;
+    }
+
+    data_ptr->needs_drain = false;
+
+    auto drain_cbs = std::move(data_ptr->drain_cbs);
+    data_ptr->drain_cbs.clear();
+
+    if (data_ptr->writable_cb) {
+      data_ptr->writable_cb();
+    }
+
+    for (auto& drain_cb : drain_cbs) {
+      drain_cb(uv::error{0});
+    }
+  }
+
+  static void failDrain(data* data_ptr, uv::error error) {
+    if (!data_ptr->needs_drain && data_ptr->drain_cbs.empty()) {
+      return;
+    }
+
+    data_ptr->needs_drain = false;
+
+    auto drain_cbs = std::move(data_ptr->drain_cbs);
+    data_ptr->drain_cbs.clear();
+
+    for (auto& drain_cb : drain_cbs) {
+      drain_cb(error);
+    }
+  }
 };
 } // namespace uv
@@ -2,16 +2,25 @@
 
 #include "./dns.hpp"
 #include "./error.hpp"
+#include "./fs.hpp"
+#include "./poll.hpp"
 #include "./stream.hpp"
 #ifndef UVPP_NO_TASK
 #include "../task.hpp"
 #endif
 #include "uv.h"
+#include <algorithm>
 #include <functional>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <unistd.h>
 
 namespace uv {
 struct tcp : public stream {
 public:
+  using native_type = uv_tcp_t;
+
   struct data : public stream::data {
     uv_tcp_t* _native_tcp;
     std::function<void()> tcp_cb;
@@ -24,9 +33,7 @@ public:
     }
   };
 
-  tcp(uv_loop_t* native_loop, uv_tcp_t* native_tcp)
-      : stream(native_tcp, new data(native_tcp)), _native_tcp(native_tcp) {
-    error::test(uv_tcp_init(native_loop, native_tcp));
+  tcp(uv_loop_t* native_loop, uv_tcp_t* native_tcp) : tcp(native_loop, native_tcp, new data(native_tcp)) {
   }
 
   tcp(uv_loop_t* native_loop) : tcp(native_loop, new uv_tcp_t()) {
@@ -180,9 +187,131 @@ public:
   }
 #endif
 
+#ifndef UVPP_NO_TASK
+  // the socket is handed to the threadpool chunk by chunk, writes made until sendFile completes fail with UV_EBUSY.
+  // with ssl the file is read and written through the stream instead
+  task<size_t> sendFile(
+      uv::file file, int64_t offset, size_t length, std::function<void(size_t)> progress_cb = nullptr) {
+#ifndef UVPP_NO_SSL
+    if (_ssl_state) {
+      co_return co_await sendFileBuffered(file, offset, length, progress_cb);
+    }
+#endif
+
+    uv_os_fd_t fd;
+    error::test(uv_fileno(*this, &fd));
+
+    // an empty write completes only after everything queued before it was flushed
+    co_await write(std::string{});
+
+    auto data_ptr = getData<stream::data>();
+    data_ptr->sending_file = true;
+
+    // libuv allows one watcher per descriptor, so writability is polled on a duplicate of the socket
+    int poll_fd = -1;
+    std::optional<uv::poll> writable;
+
+    size_t sent = 0;
+    std::exception_ptr failure;
+    try {
+      while (sent < length) {
+        size_t chunk = std::min(length - sent, sendfile_chunk_size);
+
+        uv::error error;
+        size_t result = 0;
+        try {
+          result = co_await uv::fs::sendfile(fd, file, offset + sent, chunk, loop());
+        } catch (const uv::error& e) {
+          error = e;
+        }
+
+        if (error == UV_EAGAIN) {
+          if (!writable) {
+            poll_fd = ::dup(fd);
+            if (poll_fd < 0) {
+              throw uv::error{uv_translate_sys_error(errno)};
+            }
+
+            writable.emplace(poll_fd, loop());
+          }
+
+          co_await writable->startOnce(UV_WRITABLE);
+          continue;
+        } else if (error) {
+          throw error;
+        }
+
+        if (result == 0) {
+          break;
+        }
+
+        sent += result;
+
+        if (progress_cb) {
+          progress_cb(sent);
+        }
+      }
+    } catch (...) {
+      failure = std::current_exception();
+    }
+
+    data_ptr->sending_file = false;
+
+    if (writable) {
+      co_await writable->close();
+    }
+
+    if (poll_fd >= 0) {
+      ::close(poll_fd);
+    }
+
+    if (failure) {
+      std::rethrow_exception(failure);
+    }
+
+    co_return sent;
+  }
+#endif
+
+protected:
+  tcp(uv_loop_t* native_loop, uv_tcp_t* native_tcp, data* data_ptr)
+      : stream(native_tcp, data_ptr), _native_tcp(native_tcp) {
+    error::test(uv_tcp_init(native_loop, native_tcp));
+  }
+
 private:
+  static constexpr size_t sendfile_chunk_size = 1024 * 1024;
+  static constexpr size_t sendfile_buffer_size = 65536;
+
   uv_tcp_t* _native_tcp;
 
+#ifndef UVPP_NO_TASK
+  task<size_t> sendFileBuffered(
+      uv::file file, int64_t offset, size_t length, std::function<void(size_t)>& progress_cb) {
+    std::unique_ptr<char[]> buf{new char[std::min(length, sendfile_buffer_size)]};
+
+    size_t sent = 0;
+    while (sent < length) {
+      size_t chunk = std::min(length - sent, sendfile_buffer_size);
+
+      auto view = co_await uv::fs::read(file, buf.get(), chunk, offset + sent, loop());
+      if (view.length() == 0) {
+        break;
+      }
+
+      co_await writeView(view);
+
+      sent += view.length();
+
+      if (progress_cb) {
+        progress_cb(sent);
+      }
+    }
+
+    co_return sent;
+  }
+#endif
+
   std::function<void(uv::error)> hookSSLIntoStream(std::function<void(uv::error)>& cb) {
     _ssl_state.onReadDecrypted([this](auto data) {
       auto data_ptr = getData<uv::tcp::data>();
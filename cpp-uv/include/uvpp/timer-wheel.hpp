@@ -0,0 +1,237 @@
+#pragma once
+
+#include "./error.hpp"
+#include "./timer.hpp"
+#ifndef UVPP_NO_TASK
+#include "../task.hpp"
+#endif
+#include "uv.h"
+#include <algorithm>
+#include <functional>
+
+namespace uv {
+namespace detail {
+struct timer_wheel_link {
+  timer_wheel_link* prev = this;
+  timer_wheel_link* next = this;
+
+  bool empty() const noexcept {
+    return next == this;
+  }
+
+  void pushBack(timer_wheel_link& l) noexcept {
+    l.prev = prev;
+    l.next = this;
+    prev->next = &l;
+    prev = &l;
+  }
+
+  void unlink() noexcept {
+    prev->next = next;
+    next->prev = prev;
+    prev = this;
+    next = this;
+  }
+
+  void moveTo(timer_wheel_link& target) noexcept {
+    if (empty()) {
+      return;
+    }
+
+    target.next = next;
+    target.prev = prev;
+    next->prev = &target;
+    prev->next = &target;
+    next = this;
+    prev = this;
+  }
+};
+} // namespace detail
+
+struct timer_wheel {
+public:
+  static constexpr int level_bits = 6;
+  static constexpr int level_count = 4;
+  static constexpr uint64_t slot_count = uint64_t{1} << level_bits;
+  static constexpr uint64_t slot_mask = slot_count - 1;
+  static constexpr uint64_t max_ticks = (uint64_t{1} << (level_bits * level_count)) - 1;
+
+  struct node : private detail::timer_wheel_link {
+  public:
+    friend timer_wheel;
+
+    std::function<void()> cb;
+
+    node() {
+    }
+
+    node(const node&) = delete;
+
+    node& operator=(const node&) = delete;
+
+    ~node() noexcept {
+      if (_wheel) {
+        _wheel->stop(*this);
+      }
+    }
+
+    bool isActive() const noexcept {
+      return _wheel != nullptr;
+    }
+
+  private:
+    uint64_t _expires = 0;
+    timer_wheel* _wheel = nullptr;
+  };
+
+  timer_wheel(uv_loop_t* native_loop = uv_default_loop(), uint64_t resolution = 10)
+      : _native_loop(native_loop), _timer(native_loop), _resolution(resolution) {
+    _current = uv_now(_native_loop) / _resolution;
+  }
+
+  timer_wheel(const timer_wheel&) = delete;
+
+  timer_wheel& operator=(const timer_wheel&) = delete;
+
+  ~timer_wheel() noexcept {
+    for (auto& level : _levels) {
+      for (auto& slot : level) {
+        while (!slot.empty()) {
+          auto n = static_cast<node*>(slot.next);
+          n->unlink();
+          n->_wheel = nullptr;
+        }
+      }
+    }
+  }
+
+  void start(node& n, uint64_t timeout, std::function<void()> cb) {
+    n.cb = std::move(cb);
+    start(n, timeout);
+  }
+
+  void start(node& n, uint64_t timeout) {
+    if (n._wheel) {
+      n._wheel->stop(n);
+    }
+
+    uint64_t now = uv_now(_native_loop);
+
+    if (_size == 0) {
+      _current = std::max(_current, now / _resolution);
+      _timer.start(
+          [this]() {
+            tick();
+          },
+          _resolution, _resolution);
+    }
+
+    n._expires = (now + timeout + _resolution - 1) / _resolution;
+    n._wheel = this;
+    _size += 1;
+
+    link(n);
+  }
+
+  void stop(node& n) noexcept {
+    if (n._wheel != this) {
+      return;
+    }
+
+    n.unlink();
+    n._wheel = nullptr;
+    _size -= 1;
+
+    if (_size == 0) {
+      uv_timer_stop(_timer);
+    }
+  }
+
+#ifndef UVPP_NO_TASK
+  task<void> timeout(uint64_t timeout) {
+    node n;
+
+    co_await task<void>::create([this, &n, timeout](auto& resolve, auto& reject) {
+      start(n, timeout, resolve);
+    });
+  }
+#endif
+
+  size_t size() const noexcept {
+    return _size;
+  }
+
+  uint64_t resolution() const noexcept {
+    return _resolution;
+  }
+
+private:
+  uv_loop_t* _native_loop;
+  uv::timer _timer;
+  uint64_t _resolution;
+  uint64_t _current = 0;
+  size_t _size = 0;
+
+  detail::timer_wheel_link _levels[level_count][slot_count];
+
+  void link(node& n) noexcept {
+    uint64_t expires = std::max(n._expires, _current);
+    uint64_t delta = expires - _current;
+
+    if (delta > max_ticks) {
+      delta = max_ticks;
+      expires = _current + delta;
+    }
+
+    int level = 0;
+    while (level < level_count - 1 && delta >= (uint64_t{1} << (level_bits * (level + 1)))) {
+      level += 1;
+    }
+
+    _levels[level][(expires >> (level_bits * level)) & slot_mask].pushBack(n);
+  }
+
+  uint64_t cascade(int level) noexcept {
+    uint64_t index = (_current >> (level_bits * level)) & slot_mask;
+
+    detail::timer_wheel_link pending;
+    _levels[level][index].moveTo(pending);
+
+    while (!pending.empty()) {
+      auto n = static_cast<node*>(pending.next);
+      n->unlink();
+      link(*n);
+    }
+
+    return index;
+  }
+
+  void tick() {
+    uint64_t now = uv_now(_native_loop) / _resolution;
+
+    while (_current <= now && _size > 0) {
+      uint64_t index = _current & slot_mask;
+
+      for (int level = 1; index == 0 && level < level_count; level++) {
+        if (cascade(level) != 0) {
+          break;
+        }
+      }
+
+      detail::timer_wheel_link expired;
+      _levels[0][index].moveTo(expired);
+
+      _current += 1;
+
+      while (!expired.empty()) {
+        auto n = static_cast<node*>(expired.next);
+        stop(*n);
+
+        // the callback may destroy or re-arm its own node
+        auto cb = n->cb;
+        cb();
+      }
+    }
+  }
+};
+} // namespace uv
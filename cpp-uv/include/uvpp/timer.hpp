@@ -11,6 +11,8 @@
 namespace uv {
 struct timer : public handle {
 public:
+  using native_type = uv_timer_t;
+
   struct data : public handle::data {
     uv_timer_t* _native_timer;
     std::function<void()> timer_cb;
@@ -23,9 +25,7 @@ public:
     }
   };
 
-  timer(uv_loop_t* native_loop, uv_timer_t* native_timer)
-      : handle(native_timer, new data(native_timer)), _native_timer(native_timer) {
-    error::test(uv_timer_init(native_loop, native_timer));
+  timer(uv_loop_t* native_loop, uv_timer_t* native_timer) : timer(native_loop, native_timer, new data(native_timer)) {
   }
 
   timer(uv_loop_t* native_loop) : timer(native_loop, new uv_timer_t()) {
@@ -91,6 +91,12 @@ public:
     return uv_timer_get_repeat(*this);
   }
 
+protected:
+  timer(uv_loop_t* native_loop, uv_timer_t* native_timer, data* data_ptr)
+      : handle(native_timer, data_ptr), _native_timer(native_timer) {
+    error::test(uv_timer_init(native_loop, native_timer));
+  }
+
 private:
   uv_timer_t* _native_timer;
 };